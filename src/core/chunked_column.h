@@ -0,0 +1,78 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <memory>
+#include <vector>
+
+namespace fileindexer {
+
+    // One column of the index: a vector split into chunks of CHUNK_SIZE
+    // values. Chunks are shared between copies and cloned by the first copy
+    // that changes one, as the trigram postings and ordered blocks are, so
+    // copying the index for a new snapshot costs one pointer per chunk and a
+    // change afterwards copies at most one chunk. Reads go through one more
+    // pointer than a plain vector; writes have to say so (Set, Writable).
+    template <typename T>
+    class ChunkedColumn
+    {
+    public:
+        std::size_t size() const { return size_; }
+        bool empty() const { return size_ == 0; }
+        const T& operator[](std::size_t i) const { return (*chunks_[i >> CHUNK_BITS])[i & CHUNK_MASK]; }
+
+        // the value at i, its chunk cloned first if a copy still shares it
+        T& Writable(std::size_t i) { return Writable(chunks_[i >> CHUNK_BITS])[i & CHUNK_MASK]; }
+        void Set(std::size_t i, const T& value) { Writable(i) = value; }
+
+        void push_back(const T& value)
+        {
+            if ((size_ & CHUNK_MASK) == 0)
+            {
+                chunks_.push_back(std::make_shared<Chunk>());
+                chunks_.back()->reserve(CHUNK_SIZE);
+            }
+            Writable(chunks_.back()).push_back(value);
+            ++size_;
+        }
+
+        // n copies of value, none of them shared
+        void assign(std::size_t n, const T& value)
+        {
+            chunks_.clear();
+            for (std::size_t i = 0; i < n; i += CHUNK_SIZE)
+                chunks_.push_back(std::make_shared<Chunk>(std::min(CHUNK_SIZE, n - i), value));
+            size_ = n;
+        }
+
+        void reserve(std::size_t n) { chunks_.reserve((n + CHUNK_SIZE - 1) / CHUNK_SIZE); }
+
+        // counts shared chunks in full, as if this copy were the only one
+        std::size_t MemoryUsage() const
+        {
+            return chunks_.capacity() * sizeof(std::shared_ptr<Chunk>) + chunks_.size() * CHUNK_SIZE * sizeof(T);
+        }
+
+    private:
+        using Chunk = std::vector<T>;
+
+        static constexpr unsigned CHUNK_BITS = 12;
+        static constexpr std::size_t CHUNK_SIZE = std::size_t{1} << CHUNK_BITS;
+        static constexpr std::size_t CHUNK_MASK = CHUNK_SIZE - 1;
+
+        static Chunk& Writable(std::shared_ptr<Chunk>& chunk)
+        {
+            if (chunk.use_count() > 1)
+            {
+                auto copy = std::make_shared<Chunk>();
+                copy->reserve(CHUNK_SIZE); // the last chunk keeps growing
+                copy->assign(chunk->begin(), chunk->end());
+                chunk = std::move(copy); // still part of a published snapshot
+            }
+            return *chunk;
+        }
+
+        std::vector<std::shared_ptr<Chunk>> chunks_;
+        std::size_t size_ = 0;
+    };
+}
@@ -0,0 +1,407 @@
+#include "content_index.h"
+#include "file_indexer.h"
+#include "work_stealing_pool.h"
+#include <zstd.h>
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <mutex>
+#include <thread>
+
+namespace fileindexer
+{
+    namespace
+    {
+        constexpr char MAGIC[8] = {'A', 'N', 'G', 'L', 'E', 'R', 'C', 'X'};
+        constexpr std::uint64_t FORMAT_VERSION = 1;
+        // written once per pass, so a little more effort than the main index
+        constexpr int COMPRESSION_LEVEL = 3;
+
+        constexpr std::size_t MIN_WORD = 2;
+        constexpr std::size_t MAX_WORD = 64;
+        // larger files are remembered but not read; mostly logs and dumps
+        constexpr std::uint64_t MAX_INDEXED_BYTES = 64ull << 20;
+        // a NUL byte this close to the start marks a file as binary
+        constexpr std::size_t BINARY_PROBE = 8192;
+        // files one pool task reads before merging its words
+        constexpr std::size_t FILES_PER_TASK = 32;
+        // compact once dead documents outnumber live ones
+        constexpr std::size_t DEAD_RATIO = 1;
+        // new id of a dead document during compaction
+        constexpr std::uint32_t DROPPED = ~std::uint32_t(0);
+
+        inline bool IsWordByte(unsigned char c)
+        {
+            return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9') || c == '_' || c >= 0x80;
+        }
+
+        void PutVarint(std::string &out, std::uint64_t value)
+        {
+            while (value >= 0x80)
+            {
+                out += static_cast<char>((value & 0x7F) | 0x80);
+                value >>= 7;
+            }
+            out += static_cast<char>(value);
+        }
+
+        void PutBytes(std::string &out, std::string_view bytes)
+        {
+            PutVarint(out, bytes.size());
+            out.append(bytes);
+        }
+
+        // bounds-checked reads from a decompressed index
+        struct Reader
+        {
+            std::string_view data;
+            std::size_t pos = 0;
+
+            bool Varint(std::uint64_t &value)
+            {
+                value = 0;
+                for (unsigned shift = 0; shift < 64 && pos < data.size(); shift += 7)
+                {
+                    auto byte = static_cast<unsigned char>(data[pos++]);
+                    value |= static_cast<std::uint64_t>(byte & 0x7F) << shift;
+                    if (!(byte & 0x80))
+                        return true;
+                }
+                return false;
+            }
+
+            bool Bytes(std::string &out)
+            {
+                std::uint64_t size = 0;
+                if (!Varint(size) || size > data.size() - pos)
+                    return false;
+                out.assign(data.data() + pos, static_cast<std::size_t>(size));
+                pos += static_cast<std::size_t>(size);
+                return true;
+            }
+        };
+
+        // The distinct words of one file, or none if it cannot be read or
+        // looks binary.
+        std::vector<std::string> ReadWords(const std::filesystem::path &path)
+        {
+            std::vector<std::string> words;
+            std::ifstream in(path, std::ios::binary);
+            if (!in)
+                return words;
+            std::string text((std::istreambuf_iterator<char>(in)), {});
+            if (std::memchr(text.data(), '\0', std::min(text.size(), BINARY_PROBE)))
+                return words;
+            ContentIndex::Tokenize(text, words);
+            return words;
+        }
+
+        // ascending ids in a that are also in b, which is usually the longer
+        void IntersectInto(std::vector<std::uint32_t> &a, const std::vector<std::uint32_t> &b)
+        {
+            auto from = b.begin();
+            auto kept = a.begin();
+            for (std::uint32_t id : a)
+            {
+                from = std::lower_bound(from, b.end(), id);
+                if (from == b.end())
+                    break;
+                if (*from == id)
+                    *kept++ = id;
+            }
+            a.erase(kept, a.end());
+        }
+    }
+
+    void ContentIndex::Tokenize(std::string_view text, std::vector<std::string> &words)
+    {
+        const std::size_t first = words.size();
+        for (std::size_t pos = 0; pos < text.size();)
+        {
+            if (!IsWordByte(static_cast<unsigned char>(text[pos])))
+            {
+                ++pos;
+                continue;
+            }
+            std::size_t end = pos;
+            while (end < text.size() && IsWordByte(static_cast<unsigned char>(text[end])))
+                ++end;
+            if (end - pos >= MIN_WORD && end - pos <= MAX_WORD)
+                words.push_back(ToLowerAscii(text.substr(pos, end - pos)));
+            pos = end;
+        }
+        std::sort(words.begin() + first, words.end());
+        words.erase(std::unique(words.begin() + first, words.end()), words.end());
+    }
+
+    std::uint32_t ContentIndex::AddDocument(Document document, const std::vector<std::string> &words)
+    {
+        const auto doc = static_cast<std::uint32_t>(documents_.size());
+        by_path_[document.path.native()] = doc;
+        documents_.push_back({std::move(document), true});
+        // ids only grow, so every list stays sorted
+        for (const std::string &word : words)
+            postings_[word].push_back(doc);
+        return doc;
+    }
+
+    void ContentIndex::Kill(std::uint32_t doc)
+    {
+        if (!documents_[doc].live)
+            return;
+        documents_[doc].live = false;
+        by_path_.erase(documents_[doc].document.path.native());
+        ++dead_;
+    }
+
+    void ContentIndex::Compact()
+    {
+        std::vector<std::uint32_t> renumbered(documents_.size(), DROPPED);
+        std::vector<Entry> live;
+        live.reserve(documents_.size() - dead_);
+        by_path_.clear();
+        for (std::size_t doc = 0; doc < documents_.size(); ++doc)
+        {
+            if (!documents_[doc].live)
+                continue;
+            renumbered[doc] = static_cast<std::uint32_t>(live.size());
+            by_path_[documents_[doc].document.path.native()] = renumbered[doc];
+            live.push_back(std::move(documents_[doc]));
+        }
+        documents_ = std::move(live);
+        dead_ = 0;
+
+        for (auto it = postings_.begin(); it != postings_.end();)
+        {
+            auto &ids = it->second;
+            auto kept = ids.begin();
+            for (std::uint32_t doc : ids)
+            {
+                if (renumbered[doc] != DROPPED)
+                    *kept++ = renumbered[doc];
+            }
+            ids.erase(kept, ids.end());
+            if (ids.empty())
+                it = postings_.erase(it);
+            else
+            {
+                ids.shrink_to_fit();
+                ++it;
+            }
+        }
+    }
+
+    bool ContentIndex::Refresh(const IndexStore &store, const std::atomic<bool> &keep_running)
+    {
+        std::vector<bool> seen(documents_.size(), false);
+        std::vector<Document> stale;
+        for (std::uint32_t id : store.TypeBitmap(TEXT).ToVector())
+        {
+            if (!keep_running)
+                return false;
+            Document current{store.PathOf(id), store.Size(id), store.ModifiedNs(id)};
+            auto it = by_path_.find(current.path.native());
+            if (it != by_path_.end())
+            {
+                const Document &known = documents_[it->second].document;
+                if (known.size == current.size && known.mtime == current.mtime)
+                {
+                    seen[it->second] = true;
+                    continue;
+                }
+                Kill(it->second);
+            }
+            stale.push_back(std::move(current));
+        }
+        for (std::size_t doc = 0; doc < seen.size(); ++doc)
+        {
+            if (!seen[doc])
+                Kill(static_cast<std::uint32_t>(doc));
+        }
+
+        if (!stale.empty())
+        {
+            const std::size_t tasks = (stale.size() + FILES_PER_TASK - 1) / FILES_PER_TASK;
+            unsigned hw = std::max(1u, std::thread::hardware_concurrency());
+            WorkStealingPool pool(static_cast<unsigned>(std::min<std::size_t>(hw, tasks)));
+            std::mutex merge_mutex;
+            for (std::size_t task = 0; task < tasks; ++task)
+            {
+                pool.Push(static_cast<unsigned>(task), [&, task](unsigned)
+                {
+                    const std::size_t end = std::min(stale.size(), (task + 1) * FILES_PER_TASK);
+                    for (std::size_t i = task * FILES_PER_TASK; i < end && keep_running; ++i)
+                    {
+                        Document &document = stale[i];
+                        // too large ones go in without words, so they are
+                        // not tried again until they change
+                        std::vector<std::string> words;
+                        if (document.size <= MAX_INDEXED_BYTES)
+                            words = ReadWords(document.path);
+                        std::lock_guard<std::mutex> lock(merge_mutex);
+                        AddDocument(std::move(document), words);
+                    }
+                });
+            }
+            pool.Run(keep_running);
+        }
+
+        if (dead_ > DEAD_RATIO * DocumentCount())
+            Compact();
+        return keep_running;
+    }
+
+    std::vector<ContentIndex::Document> ContentIndex::Lookup(std::string_view text, std::size_t limit) const
+    {
+        std::vector<Document> found;
+        std::vector<std::string> words;
+        Tokenize(text, words);
+        if (words.empty())
+            return found;
+
+        std::vector<const std::vector<std::uint32_t> *> lists;
+        for (const std::string &word : words)
+        {
+            auto it = postings_.find(word);
+            if (it == postings_.end())
+                return found;
+            lists.push_back(&it->second);
+        }
+        std::sort(lists.begin(), lists.end(), [](auto *a, auto *b) { return a->size() < b->size(); });
+
+        std::vector<std::uint32_t> docs = *lists.front();
+        for (std::size_t i = 1; i < lists.size() && !docs.empty(); ++i)
+            IntersectInto(docs, *lists[i]);
+
+        for (std::uint32_t doc : docs)
+        {
+            if (!documents_[doc].live)
+                continue;
+            found.push_back(documents_[doc].document);
+            if (limit != 0 && found.size() == limit)
+                break;
+        }
+        return found;
+    }
+
+    bool ContentIndex::Save(const std::filesystem::path &file)
+    {
+        if (dead_ != 0)
+            Compact();
+
+        std::string raw;
+        PutVarint(raw, FORMAT_VERSION);
+        PutVarint(raw, documents_.size());
+        for (const Entry &entry : documents_)
+        {
+            PutBytes(raw, entry.document.path.native());
+            PutVarint(raw, entry.document.size);
+            PutVarint(raw, static_cast<std::uint64_t>(entry.document.mtime));
+        }
+        PutVarint(raw, postings_.size());
+        for (const auto &[word, docs] : postings_)
+        {
+            PutBytes(raw, word);
+            PutVarint(raw, docs.size());
+            std::uint32_t previous = 0;
+            for (std::uint32_t doc : docs)
+            {
+                PutVarint(raw, doc - previous);
+                previous = doc;
+            }
+        }
+
+        std::string compressed(sizeof(MAGIC) + ZSTD_compressBound(raw.size()), '\0');
+        std::memcpy(compressed.data(), MAGIC, sizeof(MAGIC));
+        size_t size = ZSTD_compress(compressed.data() + sizeof(MAGIC), compressed.size() - sizeof(MAGIC), raw.data(), raw.size(),
+                                    COMPRESSION_LEVEL);
+        if (ZSTD_isError(size))
+        {
+            std::cerr << "Content index compression error: " << ZSTD_getErrorName(size) << "\n";
+            return false;
+        }
+        compressed.resize(sizeof(MAGIC) + size);
+
+        std::filesystem::path tmp = file;
+        tmp += ".tmp";
+        {
+            std::ofstream out(tmp, std::ios::binary);
+            if (!out.write(compressed.data(), static_cast<std::streamsize>(compressed.size())))
+            {
+                std::cerr << "Failed to save content index to " << tmp << "\n";
+                return false;
+            }
+        }
+        std::error_code ec;
+        std::filesystem::rename(tmp, file, ec);
+        if (ec)
+        {
+            std::filesystem::remove(file, ec);
+            std::filesystem::rename(tmp, file, ec);
+        }
+        return !ec;
+    }
+
+    bool ContentIndex::Load(const std::filesystem::path &file)
+    {
+        std::ifstream in(file, std::ios::binary);
+        if (!in)
+            return false;
+        std::string compressed((std::istreambuf_iterator<char>(in)), {});
+        if (compressed.size() < sizeof(MAGIC) || std::memcmp(compressed.data(), MAGIC, sizeof(MAGIC)) != 0)
+            return false;
+
+        const char *frame = compressed.data() + sizeof(MAGIC);
+        const std::size_t frame_size = compressed.size() - sizeof(MAGIC);
+        unsigned long long const raw_size = ZSTD_getFrameContentSize(frame, frame_size);
+        if (raw_size == ZSTD_CONTENTSIZE_ERROR || raw_size == ZSTD_CONTENTSIZE_UNKNOWN)
+            return false;
+        std::string raw(raw_size, '\0');
+        size_t size = ZSTD_decompress(raw.data(), raw.size(), frame, frame_size);
+        if (ZSTD_isError(size) || size != raw.size())
+            return false;
+
+        ContentIndex loaded;
+        Reader reader{raw};
+        std::uint64_t version = 0;
+        std::uint64_t count = 0;
+        if (!reader.Varint(version) || version != FORMAT_VERSION || !reader.Varint(count) || count > raw.size())
+            return false;
+        loaded.documents_.reserve(static_cast<std::size_t>(count));
+        for (std::uint64_t doc = 0; doc < count; ++doc)
+        {
+            std::string path;
+            std::uint64_t file_size = 0;
+            std::uint64_t mtime = 0;
+            if (!reader.Bytes(path) || !reader.Varint(file_size) || !reader.Varint(mtime))
+                return false;
+            loaded.AddDocument({std::filesystem::path(std::move(path)), file_size, static_cast<std::int64_t>(mtime)}, {});
+        }
+
+        std::uint64_t words = 0;
+        if (!reader.Varint(words))
+            return false;
+        loaded.postings_.reserve(static_cast<std::size_t>(std::min<std::uint64_t>(words, raw.size())));
+        for (std::uint64_t w = 0; w < words; ++w)
+        {
+            std::string word;
+            std::uint64_t docs = 0;
+            if (!reader.Bytes(word) || !reader.Varint(docs) || docs > count)
+                return false;
+            auto &ids = loaded.postings_[std::move(word)];
+            ids.reserve(static_cast<std::size_t>(docs));
+            std::uint64_t doc = 0;
+            for (std::uint64_t i = 0; i < docs; ++i)
+            {
+                std::uint64_t delta = 0;
+                if (!reader.Varint(delta) || (i != 0 && delta == 0) || (doc += delta) >= count)
+                    return false;
+                ids.push_back(static_cast<std::uint32_t>(doc));
+            }
+        }
+
+        *this = std::move(loaded);
+        return true;
+    }
+}
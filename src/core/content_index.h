@@ -0,0 +1,80 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+#include "index_store.h"
+
+namespace fileindexer {
+
+    // Inverted index over the words in text files, so that asking which
+    // files contain some words costs a few posting list intersections
+    // instead of reading every file again.
+    //
+    // A word is a run of ASCII letters, digits and underscores, or of any
+    // non-ASCII bytes, so UTF-8 words stay whole; it is kept lowercase and
+    // only if it is 2 to 64 bytes long. Postings record which files hold a
+    // word, not where.
+    //
+    // Every file is remembered with the size and mtime it had when read.
+    // Refresh rereads only the files whose fingerprint changed since, and
+    // drops the ones that left the index. A changed file gets a new
+    // document id and its old one is left dead in the postings until the
+    // next compaction, so an update never has to search every list for it.
+    //
+    // On disk the postings are delta-encoded varints and the whole file is
+    // one zstd frame.
+    class ContentIndex
+    {
+    public:
+        struct Document
+        {
+            std::filesystem::path path;
+            std::uint64_t size;
+            // file clock nanoseconds, like EntryMetadata::mtime
+            std::int64_t mtime;
+        };
+
+        // Brings the index in line with the live TEXT files of store, reading
+        // the new and changed ones on a thread pool. Returns false if
+        // keep_running turned false first; the files read by then are in.
+        bool Refresh(const IndexStore& store, const std::atomic<bool>& keep_running);
+
+        // Files containing every word of text, at most limit of them (0 =
+        // all), in the order they were indexed. Words too short to be
+        // indexed are ignored; if none is left nothing matches.
+        std::vector<Document> Lookup(std::string_view text, std::size_t limit = 0) const;
+
+        std::size_t DocumentCount() const { return documents_.size() - dead_; }
+        std::size_t WordCount() const { return postings_.size(); }
+
+        bool Save(const std::filesystem::path& file);
+        bool Load(const std::filesystem::path& file);
+
+        // appends the distinct words of text, sorted
+        static void Tokenize(std::string_view text, std::vector<std::string>& words);
+
+    private:
+        struct Entry
+        {
+            Document document;
+            bool live;
+        };
+
+        std::uint32_t AddDocument(Document document, const std::vector<std::string>& words);
+        void Kill(std::uint32_t doc);
+        // renumbers the live documents and drops the dead ones from postings
+        void Compact();
+
+        std::vector<Entry> documents_;
+        std::unordered_map<std::string, std::uint32_t> by_path_;
+        // ascending document ids per word
+        std::unordered_map<std::string, std::vector<std::uint32_t>> postings_;
+        std::size_t dead_ = 0;
+    };
+}
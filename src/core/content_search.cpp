@@ -0,0 +1,223 @@
+#include "content_search.h"
+#include "name_scan.h"
+#include "work_stealing_pool.h"
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+
+#if !defined(_WIN32)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace fileindexer
+{
+    namespace
+    {
+        // a NUL byte this close to the start marks a file as binary
+        constexpr std::size_t BINARY_PROBE = 8192;
+        // bytes scanned between two looks at the cancel flag
+        constexpr std::size_t SCAN_WINDOW = 1 << 20;
+        // longest line handed back whole; longer ones are cut around the match
+        constexpr std::size_t MAX_LINE_TEXT = 256;
+        // of MAX_LINE_TEXT, how much comes before the match when cut
+        constexpr std::size_t LINE_CONTEXT = 64;
+        // Workers per hardware thread. Searching is mostly waiting for pages
+        // to come in, so a few more threads keep more reads in flight.
+        constexpr unsigned THREADS_PER_CORE = 2;
+        constexpr unsigned MAX_THREADS = 64;
+
+        // A whole file in memory, mapped where possible and read otherwise.
+        class FileView
+        {
+        public:
+            explicit FileView(const std::filesystem::path &path)
+            {
+#if !defined(_WIN32)
+                int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+                if (fd < 0)
+                    return;
+                struct stat st;
+                if (::fstat(fd, &st) == 0 && S_ISREG(st.st_mode) && st.st_size > 0)
+                {
+                    void *mapped = ::mmap(nullptr, static_cast<std::size_t>(st.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+                    if (mapped != MAP_FAILED)
+                    {
+                        ::madvise(mapped, static_cast<std::size_t>(st.st_size), MADV_SEQUENTIAL);
+                        data_ = static_cast<const char *>(mapped);
+                        size_ = static_cast<std::size_t>(st.st_size);
+                        mapped_ = true;
+                    }
+                }
+                ::close(fd);
+                if (mapped_)
+                    return;
+#endif
+                std::ifstream in(path, std::ios::binary);
+                if (!in)
+                    return;
+                buffer_.assign(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+                data_ = buffer_.data();
+                size_ = buffer_.size();
+            }
+
+            ~FileView()
+            {
+#if !defined(_WIN32)
+                if (mapped_)
+                    ::munmap(const_cast<char *>(data_), size_);
+#endif
+            }
+
+            FileView(const FileView &) = delete;
+            FileView &operator=(const FileView &) = delete;
+
+            std::string_view View() const { return {data_, size_}; }
+
+        private:
+            const char *data_ = nullptr;
+            std::size_t size_ = 0;
+            bool mapped_ = false;
+            std::string buffer_;
+        };
+
+        std::string LineText(std::string_view line, std::size_t column)
+        {
+            if (!line.empty() && line.back() == '\r')
+                line.remove_suffix(1);
+            if (line.size() <= MAX_LINE_TEXT)
+                return std::string(line);
+            std::size_t from = std::min(column > LINE_CONTEXT ? column - LINE_CONTEXT : 0, line.size() - MAX_LINE_TEXT);
+            return std::string(line.substr(from, MAX_LINE_TEXT));
+        }
+    }
+
+    ContentSearch::~ContentSearch()
+    {
+        Cancel();
+    }
+
+    void ContentSearch::Start(IndexSnapshot index, std::vector<EntryId> files, std::string text, bool match_case,
+                              std::size_t max_hits)
+    {
+        std::lock_guard<std::mutex> control(control_mutex_);
+        keep_running_ = false;
+        if (thread_.joinable())
+            thread_.join();
+
+        {
+            std::lock_guard<std::mutex> lock(hits_mutex_);
+            hits_.clear();
+        }
+        files_searched_ = 0;
+        file_count_ = files.size();
+        max_hits_ = max_hits;
+        hit_count_ = 0;
+        if (text.empty() || files.empty())
+            return;
+
+        keep_running_ = true;
+        running_ = true;
+        if (!match_case)
+            text = ToLowerAscii(text);
+
+        thread_ = std::thread([this, index = std::move(index), files = std::move(files), text = std::move(text), match_case]()
+        {
+            unsigned hw = std::max(1u, std::thread::hardware_concurrency());
+            unsigned threads = static_cast<unsigned>(std::min<std::size_t>(std::min(hw * THREADS_PER_CORE, MAX_THREADS), files.size()));
+            WorkStealingPool pool(threads);
+
+            // Each worker gets a contiguous run of files, pushed back to front
+            // since workers take their own newest task first; files near each
+            // other in the list then tend to be read one after another.
+            for (std::size_t i = files.size(); i-- > 0;)
+            {
+                const EntryId id = files[i];
+                pool.Push(static_cast<unsigned>(i * threads / files.size()), [&, id](unsigned)
+                {
+                    if (index->IsLive(id))
+                        SearchFile(index->PathOf(id), text, match_case);
+                    ++files_searched_;
+                });
+            }
+            pool.Run(keep_running_);
+            running_ = false;
+        });
+    }
+
+    void ContentSearch::Cancel()
+    {
+        std::lock_guard<std::mutex> control(control_mutex_);
+        keep_running_ = false;
+        if (thread_.joinable())
+            thread_.join();
+        running_ = false;
+    }
+
+    std::vector<ContentHit> ContentSearch::TakeHits()
+    {
+        std::lock_guard<std::mutex> lock(hits_mutex_);
+        std::vector<ContentHit> taken;
+        taken.swap(hits_);
+        return taken;
+    }
+
+    void ContentSearch::SearchFile(const std::filesystem::path &path, const std::string &needle, bool match_case)
+    {
+        const FileView file(path);
+        const std::string_view data = file.View();
+        const std::size_t n = needle.size();
+        if (data.size() < n || std::memchr(data.data(), '\0', std::min(data.size(), BINARY_PROBE)))
+            return;
+
+        std::vector<ContentHit> found;
+        std::uint32_t line = 1;
+        // newlines before counted are in line, and line starts at line_start
+        std::size_t counted = 0;
+        std::size_t line_start = 0;
+
+        for (std::size_t pos = 0; pos + n <= data.size() && keep_running_;)
+        {
+            // the window overlaps the next by n - 1 bytes, so no match straddles two
+            const std::string_view window = data.substr(0, std::min(data.size(), pos + SCAN_WINDOW + n - 1));
+            const std::size_t at = match_case ? FindLowered(window, needle, pos) : FindIgnoringCase(window, needle, pos);
+            if (at == std::string_view::npos)
+            {
+                pos = window.size() - n + 1;
+                continue;
+            }
+
+            for (const char *nl; (nl = static_cast<const char *>(std::memchr(data.data() + counted, '\n', at - counted)));)
+            {
+                counted = static_cast<std::size_t>(nl - data.data()) + 1;
+                line_start = counted;
+                ++line;
+            }
+            counted = at;
+
+            if (max_hits_ != 0 && hit_count_.fetch_add(1) >= max_hits_)
+            {
+                keep_running_ = false;
+                break;
+            }
+
+            std::size_t line_end = std::min(data.find('\n', at), data.size());
+            const std::size_t column = at - line_start;
+            found.push_back({path, line, static_cast<std::uint32_t>(column + 1),
+                             LineText(data.substr(line_start, line_end - line_start), column)});
+
+            // one hit per line: carry on past its end
+            if (line_end == data.size())
+                break;
+            pos = counted = line_start = line_end + 1;
+            ++line;
+        }
+
+        if (found.empty())
+            return;
+        std::lock_guard<std::mutex> lock(hits_mutex_);
+        hits_.insert(hits_.end(), std::make_move_iterator(found.begin()), std::make_move_iterator(found.end()));
+    }
+}
@@ -0,0 +1,75 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include "index_store.h"
+
+namespace fileindexer {
+
+    // one line of one file that contains the searched text
+    struct ContentHit
+    {
+        std::filesystem::path path;
+        // both 1-based; the column counts bytes from the start of the line
+        std::uint32_t line;
+        std::uint32_t column;
+        // the line without its line break, cut down around the match if long
+        std::string text;
+    };
+
+    // Searches the contents of indexed files for a piece of text in the
+    // background, the way grep does, and hands hits over as they come in.
+    //
+    // Files are spread over a thread pool with more workers than cores,
+    // since most of the time goes to waiting on the disk. Each file is mapped
+    // rather than read where the platform allows it, with the kernel told it
+    // is read front to back, and scanned with the same SIMD kernel as names.
+    // A file with a NUL byte near its start is taken for binary and skipped.
+    //
+    // Starting a search cancels the one before it, and a running search
+    // notices cancellation between files and every megabyte within one.
+    class ContentSearch
+    {
+    public:
+        ContentSearch() = default;
+        ContentSearch(const ContentSearch&) = delete;
+        ContentSearch& operator=(const ContentSearch&) = delete;
+        ~ContentSearch();
+
+        // Looks for text in files, ids into index, in that order as far as
+        // the pool allows. Lines are reported once however often they match.
+        // Stops after max_hits lines (0 = no limit).
+        void Start(IndexSnapshot index, std::vector<EntryId> files, std::string text, bool match_case,
+                   std::size_t max_hits = 0);
+        // stops the running search and waits for it; hits found so far stay
+        void Cancel();
+        bool Running() const { return running_; }
+
+        // hits found since the last call, per file in the order files finish
+        std::vector<ContentHit> TakeHits();
+        std::size_t FilesSearched() const { return files_searched_; }
+        std::size_t FileCount() const { return file_count_; }
+
+    private:
+        void SearchFile(const std::filesystem::path& path, const std::string& needle, bool match_case);
+
+        // serializes Start and Cancel
+        std::mutex control_mutex_;
+        std::thread thread_;
+        std::atomic<bool> keep_running_{false};
+        std::atomic<bool> running_{false};
+        std::atomic<std::size_t> files_searched_{0};
+        std::size_t file_count_ = 0;
+        std::size_t max_hits_ = 0;
+        std::atomic<std::size_t> hit_count_{0};
+
+        std::mutex hits_mutex_;
+        std::vector<ContentHit> hits_;
+    };
+}
@@ -0,0 +1,585 @@
+#include "crawl_backend.h"
+#include <iostream>
+#include <vector>
+#include <cstring>
+#include <cstdlib>
+#include <cstdint>
+#include <chrono>
+#include <atomic>
+#include <mutex>
+#include <unordered_map>
+
+#if !defined(_WIN32)
+#include <sys/stat.h>
+#endif
+
+#if defined(__linux__)
+#include <dirent.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include "io_uring_engine.h"
+#endif
+
+namespace fileindexer
+{
+    namespace
+    {
+        // std::filesystem has no inode or ctime; ask the OS where we can
+        void FillIdentityPortable(const std::filesystem::path &path, DirEntryInfo &info)
+        {
+            info.inode = 0;
+            info.change_time_ns = 0;
+#if !defined(_WIN32)
+            struct stat st;
+            if (::stat(path.c_str(), &st) == 0)
+            {
+                info.inode = static_cast<std::uint64_t>(st.st_ino);
+#if defined(__APPLE__)
+                info.change_time_ns = static_cast<std::int64_t>(st.st_ctimespec.tv_sec) * 1000000000 + st.st_ctimespec.tv_nsec;
+#else
+                info.change_time_ns = static_cast<std::int64_t>(st.st_ctim.tv_sec) * 1000000000 + st.st_ctim.tv_nsec;
+#endif
+            }
+#endif
+        }
+
+        bool ListDirectoryPortable(const std::filesystem::path &dir, const DirEntryCallback &on_entry)
+        {
+            std::error_code ec;
+
+            auto iterator = std::filesystem::directory_iterator(dir, std::filesystem::directory_options::skip_permission_denied, ec);
+
+            if (ec)
+            {
+                std::cerr << "Error opening directory: " << dir << " - " << ec.message() << "\n";
+                return false;
+            }
+
+            try {
+                for (const auto &entry : iterator)
+                {
+                    ec.clear();
+
+                    DirEntryInfo info;
+                    const std::string filename = entry.path().filename().string();
+                    info.name = filename;
+
+                    if (entry.is_directory(ec) && !ec)
+                    {
+                        info.is_directory = true;
+                        info.size = 0;
+                    }
+                    else if (entry.is_regular_file(ec) && !ec)
+                    {
+                        info.is_directory = false;
+                        info.size = entry.file_size(ec);
+                        if (ec) continue;
+                    }
+                    else
+                    {
+                        continue;
+                    }
+
+                    info.last_modified = entry.last_write_time(ec);
+                    if (ec) continue;
+                    FillIdentityPortable(entry.path(), info);
+
+                    if (!on_entry(info))
+                        break;
+                }
+            }
+            catch (const std::exception &e)
+            {
+                std::cerr << "Error during indexing: " << e.what() << "\n";
+            }
+            return true;
+        }
+
+        bool StatEntriesPortable(const std::filesystem::path &dir, const std::vector<std::string> &names, const DirEntryCallback &on_entry)
+        {
+            for (const auto &name : names)
+            {
+                std::error_code ec;
+                const auto path = dir / name;
+                auto status = std::filesystem::status(path, ec);
+                if (ec) continue;
+
+                DirEntryInfo info;
+                info.name = name;
+                if (std::filesystem::is_directory(status))
+                {
+                    info.is_directory = true;
+                    info.size = 0;
+                }
+                else if (std::filesystem::is_regular_file(status))
+                {
+                    info.is_directory = false;
+                    info.size = std::filesystem::file_size(path, ec);
+                    if (ec) continue;
+                }
+                else
+                {
+                    continue;
+                }
+
+                info.last_modified = std::filesystem::last_write_time(path, ec);
+                if (ec) continue;
+                FillIdentityPortable(path, info);
+
+                if (!on_entry(info))
+                    break;
+            }
+            return true;
+        }
+
+#if defined(__linux__)
+        // layout the kernel writes for getdents64, glibc does not export it
+        struct linux_dirent64
+        {
+            ino64_t d_ino;
+            off64_t d_off;
+            unsigned short d_reclen;
+            unsigned char d_type;
+            char d_name[];
+        };
+
+        // file_time_type has its own epoch; derive the offset from a path we can
+        // read through both APIs so the two backends produce identical stamps
+        std::filesystem::file_time_type::duration FileClockOffset()
+        {
+            static const auto offset = []()
+            {
+                struct stat st;
+                std::error_code ec;
+                auto reference = std::filesystem::last_write_time("/", ec);
+                if (ec || ::stat("/", &st) != 0)
+                    return std::filesystem::file_time_type::duration::zero();
+
+                auto since_unix = std::chrono::seconds(st.st_mtim.tv_sec) + std::chrono::nanoseconds(st.st_mtim.tv_nsec);
+                return reference.time_since_epoch() -
+                       std::chrono::duration_cast<std::filesystem::file_time_type::duration>(since_unix);
+            }();
+            return offset;
+        }
+
+        std::filesystem::file_time_type FromTimespec(std::int64_t sec, std::int64_t nsec)
+        {
+            auto since_unix = std::chrono::seconds(sec) + std::chrono::nanoseconds(nsec);
+            return std::filesystem::file_time_type(
+                std::chrono::duration_cast<std::filesystem::file_time_type::duration>(since_unix) + FileClockOffset());
+        }
+
+        struct DirFd
+        {
+            int fd;
+            explicit DirFd(int f) : fd(f) {}
+            ~DirFd()
+            {
+                if (fd >= 0) close(fd);
+            }
+        };
+
+        // child directories opened ahead of time by the io_uring backend, keyed
+        // by path so whichever worker lists the directory can pick the fd up
+        constexpr size_t MAX_PREFETCHED_DIRS = 512;
+        std::mutex prefetch_mutex;
+        std::unordered_map<std::string, int> prefetched_dirs;
+        std::atomic<size_t> prefetched_count{0};
+
+        void StorePrefetchedDirectory(std::string path, int fd)
+        {
+            std::lock_guard<std::mutex> lock(prefetch_mutex);
+            auto [it, inserted] = prefetched_dirs.emplace(std::move(path), fd);
+            if (!inserted)
+            {
+                close(fd);
+                prefetched_count.fetch_sub(1, std::memory_order_relaxed);
+            }
+        }
+
+        int TakePrefetchedDirectory(const std::filesystem::path &dir)
+        {
+            if (prefetched_count.load(std::memory_order_relaxed) == 0)
+                return -1;
+
+            std::lock_guard<std::mutex> lock(prefetch_mutex);
+            auto it = prefetched_dirs.find(dir.native());
+            if (it == prefetched_dirs.end())
+                return -1;
+            int fd = it->second;
+            prefetched_dirs.erase(it);
+            prefetched_count.fetch_sub(1, std::memory_order_relaxed);
+            return fd;
+        }
+
+        // returns false and logs on failure; permission errors are silently
+        // treated as an empty directory to match skip_permission_denied
+        bool OpenDirectory(const std::filesystem::path &dir, DirFd &dfd, bool &skip)
+        {
+            skip = false;
+            if (dfd.fd >= 0)
+                return true;
+
+            dfd.fd = open(dir.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+            if (dfd.fd >= 0)
+                return true;
+
+            int err = errno;
+            if (err == EACCES || err == EPERM)
+            {
+                skip = true;
+                return true;
+            }
+            std::cerr << "Error opening directory: " << dir << " - " << std::strerror(err) << "\n";
+            return false;
+        }
+
+        bool IsDotOrDotDot(const char *name)
+        {
+            return name[0] == '.' && (name[1] == '\0' || (name[1] == '.' && name[2] == '\0'));
+        }
+
+        // fifos, sockets and devices never make it into the index, and d_type
+        // lets us drop them without a stat. Returns false for those.
+        bool StatFlagsForType(unsigned char d_type, int &flags)
+        {
+            switch (d_type)
+            {
+            case DT_DIR:
+            case DT_REG:
+                flags = AT_SYMLINK_NOFOLLOW;
+                return true;
+            case DT_LNK:
+            case DT_UNKNOWN:
+                flags = 0;
+                return true;
+            default:
+                return false;
+            }
+        }
+
+        // fills info from raw stat fields; false if neither file nor directory
+        bool FillEntry(DirEntryInfo &info, const char *name, unsigned mode, std::uint64_t size,
+                       std::int64_t mtime_sec, std::int64_t mtime_nsec,
+                       std::uint64_t inode, std::int64_t ctime_sec, std::int64_t ctime_nsec)
+        {
+            info.name = name;
+            if (S_ISDIR(mode))
+            {
+                info.is_directory = true;
+                info.size = 0;
+            }
+            else if (S_ISREG(mode))
+            {
+                info.is_directory = false;
+                info.size = static_cast<std::uintmax_t>(size);
+            }
+            else
+            {
+                return false;
+            }
+            info.last_modified = FromTimespec(mtime_sec, mtime_nsec);
+            info.inode = inode;
+            info.change_time_ns = ctime_sec * 1000000000 + ctime_nsec;
+            return true;
+        }
+
+        // reads one getdents64 chunk into the thread's buffer; <= 0 means done
+        long ReadDirectoryChunk(int fd, std::vector<char> &buffer, const std::filesystem::path &dir)
+        {
+            long n = syscall(SYS_getdents64, fd, buffer.data(), buffer.size());
+            if (n < 0)
+                std::cerr << "Error reading directory: " << dir << " - " << std::strerror(errno) << "\n";
+            return n;
+        }
+
+        bool ListDirectoryNative(const std::filesystem::path &dir, const DirEntryCallback &on_entry)
+        {
+            DirFd dfd(-1);
+            bool skip = false;
+            if (!OpenDirectory(dir, dfd, skip))
+                return false;
+            if (skip)
+                return true;
+
+            // reused across every directory this thread lists
+            thread_local std::vector<char> buffer(64 * 1024);
+
+            for (long n; (n = ReadDirectoryChunk(dfd.fd, buffer, dir)) > 0;)
+            {
+                for (long offset = 0; offset < n;)
+                {
+                    auto *d = reinterpret_cast<linux_dirent64 *>(buffer.data() + offset);
+                    offset += d->d_reclen;
+
+                    int flags;
+                    if (IsDotOrDotDot(d->d_name) || !StatFlagsForType(d->d_type, flags))
+                        continue;
+
+                    struct stat st;
+                    if (fstatat(dfd.fd, d->d_name, &st, flags) != 0)
+                        continue;
+
+                    DirEntryInfo info;
+                    if (!FillEntry(info, d->d_name, st.st_mode, st.st_size, st.st_mtim.tv_sec, st.st_mtim.tv_nsec,
+                               st.st_ino, st.st_ctim.tv_sec, st.st_ctim.tv_nsec))
+                        continue;
+
+                    if (!on_entry(info))
+                        return true;
+                }
+            }
+            return true;
+        }
+
+        bool ListDirectoryIoUring(const std::filesystem::path &dir, const DirEntryCallback &on_entry)
+        {
+            DirFd dfd(TakePrefetchedDirectory(dir));
+            bool skip = false;
+            if (!OpenDirectory(dir, dfd, skip))
+                return false;
+            if (skip)
+                return true;
+
+            thread_local std::vector<char> buffer(64 * 1024);
+            thread_local std::vector<StatxRequest> requests;
+
+            for (long n; (n = ReadDirectoryChunk(dfd.fd, buffer, dir)) > 0;)
+            {
+                // names point into buffer, so the whole chunk is resolved
+                // before the next getdents64 call overwrites it
+                requests.clear();
+                for (long offset = 0; offset < n;)
+                {
+                    auto *d = reinterpret_cast<linux_dirent64 *>(buffer.data() + offset);
+                    offset += d->d_reclen;
+
+                    int flags;
+                    if (IsDotOrDotDot(d->d_name) || !StatFlagsForType(d->d_type, flags))
+                        continue;
+
+                    StatxRequest req;
+                    req.name = d->d_name;
+                    req.flags = flags;
+                    req.open_directory = d->d_type == DT_DIR &&
+                                         prefetched_count.fetch_add(1, std::memory_order_relaxed) < MAX_PREFETCHED_DIRS;
+                    if (d->d_type == DT_DIR && !req.open_directory)
+                        prefetched_count.fetch_sub(1, std::memory_order_relaxed);
+                    requests.push_back(req);
+                }
+
+                if (!IoUringStatBatch(dfd.fd, requests.data(), requests.size()))
+                {
+                    // ring went away under us, finish this chunk synchronously
+                    for (auto &req : requests)
+                    {
+                        if (req.open_directory)
+                            prefetched_count.fetch_sub(1, std::memory_order_relaxed);
+                        req.open_directory = false;
+                        req.open_result = -1;
+                        req.stat_result = statx(dfd.fd, req.name, req.flags, STATX_FINGERPRINT_MASK, &req.stx) == 0 ? 0 : -errno;
+                    }
+                }
+
+                bool keep_going = true;
+                for (auto &req : requests)
+                {
+                    DirEntryInfo info;
+                    bool valid = keep_going && req.stat_result == 0 &&
+                                 FillEntry(info, req.name, req.stx.stx_mode, req.stx.stx_size,
+                                           req.stx.stx_mtime.tv_sec, req.stx.stx_mtime.tv_nsec,
+                                           req.stx.stx_ino, req.stx.stx_ctime.tv_sec, req.stx.stx_ctime.tv_nsec);
+
+                    if (req.open_directory)
+                    {
+                        // hand the fd over before the callback queues the child
+                        if (req.open_result >= 0 && valid && info.is_directory)
+                            StorePrefetchedDirectory((dir / req.name).native(), req.open_result);
+                        else
+                        {
+                            if (req.open_result >= 0)
+                                close(req.open_result);
+                            prefetched_count.fetch_sub(1, std::memory_order_relaxed);
+                        }
+                    }
+
+                    if (valid && !on_entry(info))
+                        keep_going = false;
+                }
+                if (!keep_going)
+                    return true;
+            }
+            return true;
+        }
+
+        bool StatEntriesNative(const std::filesystem::path &dir, const std::vector<std::string> &names, const DirEntryCallback &on_entry)
+        {
+            DirFd dfd(-1);
+            bool skip = false;
+            if (!OpenDirectory(dir, dfd, skip))
+                return false;
+            if (skip)
+                return true;
+
+            for (const auto &name : names)
+            {
+                struct stat st;
+                if (fstatat(dfd.fd, name.c_str(), &st, 0) != 0)
+                    continue;
+
+                DirEntryInfo info;
+                if (!FillEntry(info, name.c_str(), st.st_mode, st.st_size, st.st_mtim.tv_sec, st.st_mtim.tv_nsec,
+                               st.st_ino, st.st_ctim.tv_sec, st.st_ctim.tv_nsec))
+                    continue;
+
+                if (!on_entry(info))
+                    break;
+            }
+            return true;
+        }
+
+        bool StatEntriesIoUring(const std::filesystem::path &dir, const std::vector<std::string> &names, const DirEntryCallback &on_entry)
+        {
+            DirFd dfd(TakePrefetchedDirectory(dir));
+            bool skip = false;
+            if (!OpenDirectory(dir, dfd, skip))
+                return false;
+            if (skip)
+                return true;
+
+            thread_local std::vector<StatxRequest> requests;
+            requests.clear();
+            for (const auto &name : names)
+            {
+                StatxRequest req;
+                req.name = name.c_str();
+                req.flags = 0;
+                req.open_directory = false;
+                requests.push_back(req);
+            }
+
+            if (!IoUringStatBatch(dfd.fd, requests.data(), requests.size()))
+                return StatEntriesNative(dir, names, on_entry);
+
+            for (const auto &req : requests)
+            {
+                DirEntryInfo info;
+                if (req.stat_result != 0 ||
+                    !FillEntry(info, req.name, req.stx.stx_mode, req.stx.stx_size,
+                               req.stx.stx_mtime.tv_sec, req.stx.stx_mtime.tv_nsec,
+                                           req.stx.stx_ino, req.stx.stx_ctime.tv_sec, req.stx.stx_ctime.tv_nsec))
+                    continue;
+
+                if (!on_entry(info))
+                    break;
+            }
+            return true;
+        }
+#endif
+    }
+
+    bool IsBackendAvailable(CrawlBackend backend)
+    {
+        switch (backend)
+        {
+        case CrawlBackend::PORTABLE:
+            return true;
+        case CrawlBackend::NATIVE:
+#if defined(__linux__)
+            return true;
+#else
+            return false;
+#endif
+        case CrawlBackend::IO_URING:
+#if defined(__linux__)
+            return IoUringAvailable();
+#else
+            return false;
+#endif
+        }
+        return false;
+    }
+
+    CrawlBackend DefaultCrawlBackend()
+    {
+        CrawlBackend backend;
+        const char *requested = std::getenv("ANGLER_CRAWL_BACKEND");
+        if (requested && ParseCrawlBackend(requested, backend))
+            return backend;
+
+        return IsBackendAvailable(CrawlBackend::NATIVE) ? CrawlBackend::NATIVE : CrawlBackend::PORTABLE;
+    }
+
+    bool ParseCrawlBackend(const std::string &name, CrawlBackend &out)
+    {
+        if (name == "portable")
+            out = CrawlBackend::PORTABLE;
+        else if (name == "native")
+            out = CrawlBackend::NATIVE;
+        else if (name == "io_uring")
+            out = CrawlBackend::IO_URING;
+        else
+        {
+            std::cerr << "Unknown crawl backend: " << name << "\n";
+            return false;
+        }
+        return true;
+    }
+
+    const char *CrawlBackendName(CrawlBackend backend)
+    {
+        switch (backend)
+        {
+        case CrawlBackend::PORTABLE:
+            return "portable";
+        case CrawlBackend::NATIVE:
+            return "native";
+        case CrawlBackend::IO_URING:
+            return "io_uring";
+        }
+        return "unknown";
+    }
+
+    bool ListDirectory(CrawlBackend backend, const std::filesystem::path &dir, const DirEntryCallback &on_entry)
+    {
+#if defined(__linux__)
+        if (backend == CrawlBackend::IO_URING)
+        {
+            if (IoUringAvailable())
+                return ListDirectoryIoUring(dir, on_entry);
+            backend = CrawlBackend::NATIVE;
+        }
+        if (backend == CrawlBackend::NATIVE)
+            return ListDirectoryNative(dir, on_entry);
+#endif
+        return ListDirectoryPortable(dir, on_entry);
+    }
+
+    bool StatEntries(CrawlBackend backend, const std::filesystem::path &dir, const std::vector<std::string> &names, const DirEntryCallback &on_entry)
+    {
+#if defined(__linux__)
+        if (backend == CrawlBackend::IO_URING)
+        {
+            if (IoUringAvailable())
+                return StatEntriesIoUring(dir, names, on_entry);
+            backend = CrawlBackend::NATIVE;
+        }
+        if (backend == CrawlBackend::NATIVE)
+            return StatEntriesNative(dir, names, on_entry);
+#endif
+        return StatEntriesPortable(dir, names, on_entry);
+    }
+
+    void ReleasePrefetchedDirectories()
+    {
+#if defined(__linux__)
+        std::lock_guard<std::mutex> lock(prefetch_mutex);
+        for (auto &[path, fd] : prefetched_dirs)
+            close(fd);
+        prefetched_count.fetch_sub(prefetched_dirs.size(), std::memory_order_relaxed);
+        prefetched_dirs.clear();
+#endif
+    }
+}
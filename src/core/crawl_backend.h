@@ -0,0 +1,55 @@
+#pragma once
+
+#include <cstdint>
+#include <filesystem>
+#include <functional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace fileindexer {
+
+    enum class CrawlBackend
+    {
+        PORTABLE, // std::filesystem, works everywhere
+        NATIVE,   // getdents64 + fstatat relative to the directory fd (Linux only)
+        IO_URING  // getdents64 + batched statx/openat through io_uring, else NATIVE
+    };
+
+    // One listed entry. name points into a buffer owned by the backend and is
+    // only valid for the duration of the callback.
+    struct DirEntryInfo {
+        std::string_view name;
+        bool is_directory;
+        std::uintmax_t size;
+        std::filesystem::file_time_type last_modified;
+        // together with size and last_modified, identifies this exact version
+        // of the entry; both are 0 where the platform does not expose them
+        std::uint64_t inode;
+        std::int64_t change_time_ns;
+    };
+
+    // return false to stop listing early
+    using DirEntryCallback = std::function<bool(const DirEntryInfo&)>;
+
+    bool IsBackendAvailable(CrawlBackend backend);
+
+    // NATIVE where available, overridable with ANGLER_CRAWL_BACKEND=portable|native|io_uring
+    // so the same build can be benchmarked against the same tree in every mode
+    CrawlBackend DefaultCrawlBackend();
+    bool ParseCrawlBackend(const std::string& name, CrawlBackend& out);
+    const char* CrawlBackendName(CrawlBackend backend);
+
+    // Lists the regular files and directories directly inside dir (symlinks are
+    // followed). Falls back to the portable backend if the requested one is
+    // unavailable. Returns false if the directory could not be opened.
+    bool ListDirectory(CrawlBackend backend, const std::filesystem::path& dir, const DirEntryCallback& on_entry);
+
+    // Stats the named entries of dir without listing it (one stat each, batched
+    // on IO_URING). Names that no longer exist are skipped.
+    bool StatEntries(CrawlBackend backend, const std::filesystem::path& dir, const std::vector<std::string>& names, const DirEntryCallback& on_entry);
+
+    // IO_URING opens child directories ahead of time; call once a crawl is done
+    // to close whatever was opened but never listed.
+    void ReleasePrefetchedDirectories();
+}
@@ -0,0 +1,272 @@
+#include "duplicate_finder.h"
+#include "work_stealing_pool.h"
+#include <algorithm>
+#include <fstream>
+#include <thread>
+#include "common/xxhash.h"
+#if !defined(_WIN32)
+#include <sys/stat.h>
+#endif
+
+namespace fileindexer
+{
+    namespace
+    {
+        // bytes hashed from each end in the second stage
+        constexpr std::size_t EDGE_BYTES = 4096;
+        // read size of the full hash; large enough that the disk streams
+        constexpr std::size_t READ_CHUNK = 1 << 20;
+
+        // XXH64 of the first and last EDGE_BYTES of a file, which is all of
+        // it up to 2 * EDGE_BYTES
+        bool HashEdges(const std::filesystem::path &path, std::uint64_t size, std::vector<char> &buffer, std::uint64_t &hash)
+        {
+            std::ifstream in(path, std::ios::binary);
+            if (!in)
+                return false;
+            const auto head = static_cast<std::size_t>(std::min<std::uint64_t>(size, EDGE_BYTES));
+            const auto tail = static_cast<std::size_t>(std::min<std::uint64_t>(size - head, EDGE_BYTES));
+            buffer.resize(std::max(buffer.size(), head + tail));
+            if (!in.read(buffer.data(), static_cast<std::streamsize>(head)))
+                return false;
+            if (tail != 0)
+            {
+                in.seekg(static_cast<std::streamoff>(size - tail));
+                if (!in.read(buffer.data() + head, static_cast<std::streamsize>(tail)))
+                    return false;
+            }
+            hash = XXH64(buffer.data(), head + tail, 0);
+            return true;
+        }
+
+        bool HashWhole(const std::filesystem::path &path, std::uint64_t size, std::vector<char> &buffer, std::uint64_t &hash)
+        {
+            std::ifstream in(path, std::ios::binary);
+            if (!in)
+                return false;
+            buffer.resize(std::max(buffer.size(), READ_CHUNK));
+            XXH64_state_t *state = XXH64_createState();
+            if (!state)
+                return false;
+            XXH64_reset(state, 0);
+            std::uint64_t left = size;
+            while (left != 0)
+            {
+                const auto chunk = static_cast<std::size_t>(std::min<std::uint64_t>(left, READ_CHUNK));
+                if (!in.read(buffer.data(), static_cast<std::streamsize>(chunk)))
+                    break;
+                XXH64_update(state, buffer.data(), chunk);
+                left -= chunk;
+            }
+            hash = XXH64_digest(state);
+            XXH64_freeState(state);
+            // a file that shrank since it was indexed is not what the index says
+            return left == 0;
+        }
+
+        std::uint64_t Wasted(const DuplicateGroup &group)
+        {
+            return group.size * (group.files.size() - 1);
+        }
+    }
+
+    DuplicateFinder::FileKey DuplicateFinder::KeyOf(const std::filesystem::path &path, const EntryMetadata &meta)
+    {
+        FileKey key{0, meta.inode, meta.size, meta.mtime};
+#if !defined(_WIN32)
+        // the index keeps no device, so ask for both; the file is about to
+        // be opened anyway
+        struct stat st;
+        if (::stat(path.c_str(), &st) == 0)
+        {
+            key.device = static_cast<std::uint64_t>(st.st_dev);
+            key.inode = static_cast<std::uint64_t>(st.st_ino);
+        }
+        else
+        {
+            key.inode = 0;
+        }
+#else
+        (void)path;
+#endif
+        return key;
+    }
+
+    bool DuplicateFinder::Lookup(const FileKey &key, bool full, std::uint64_t &hash, Cache &seen)
+    {
+        // an inode of 0 means KeyOf found none, and then the key says too little
+        if (key.inode == 0)
+            return false;
+        std::lock_guard<std::mutex> lock(cache_mutex_);
+        auto it = cache_.find(key);
+        if (it == cache_.end() || !(full ? it->second.has_full : it->second.has_edges))
+            return false;
+        hash = full ? it->second.full : it->second.edges;
+        // the whole entry, so a later run still finds the other hash
+        auto [kept, added] = seen.insert(*it);
+        if (!added)
+            Note(kept->second, full, hash);
+        return true;
+    }
+
+    void DuplicateFinder::Remember(const FileKey &key, bool full, std::uint64_t hash, Cache &seen)
+    {
+        if (key.inode == 0)
+            return;
+        std::lock_guard<std::mutex> lock(cache_mutex_);
+        Note(seen[key], full, hash);
+    }
+
+    void DuplicateFinder::Note(CachedHashes &cached, bool full, std::uint64_t hash)
+    {
+        (full ? cached.full : cached.edges) = hash;
+        (full ? cached.has_full : cached.has_edges) = true;
+    }
+
+    void DuplicateFinder::Keep(Cache &seen, bool complete)
+    {
+        std::lock_guard<std::mutex> lock(cache_mutex_);
+        // a cancelled Find saw too little to judge, and another one still
+        // running may look up what this one never saw
+        const bool alone = --finds_running_ == 0;
+        if (complete && alone)
+        {
+            cache_.swap(seen);
+            return;
+        }
+        for (const auto &[key, hashes] : seen)
+            cache_[key] = hashes;
+    }
+
+    std::vector<DuplicateGroup> DuplicateFinder::Refine(const IndexStore &index, const std::vector<DuplicateGroup> &groups,
+                                                        bool full, const std::atomic<bool> &keep_running, Cache &seen)
+    {
+        // (group, hash, id) per file that could be read
+        struct Hashed
+        {
+            std::size_t group;
+            std::uint64_t hash;
+            EntryId id;
+
+            bool operator<(const Hashed &other) const
+            {
+                return group != other.group ? group < other.group : (hash != other.hash ? hash < other.hash : id < other.id);
+            }
+        };
+
+        if (groups.empty())
+            return {};
+
+        std::vector<std::pair<std::size_t, EntryId>> files;
+        for (std::size_t g = 0; g < groups.size(); ++g)
+        {
+            for (EntryId id : groups[g].files)
+                files.emplace_back(g, id);
+        }
+        std::vector<Hashed> hashed(files.size());
+        std::vector<char> read(files.size(), false);
+
+        unsigned hw = std::max(1u, std::thread::hardware_concurrency());
+        WorkStealingPool pool(static_cast<unsigned>(std::min<std::size_t>(hw, std::max<std::size_t>(files.size(), 1))));
+        std::vector<std::vector<char>> buffers(pool.ThreadCount());
+        for (std::size_t i = 0; i < files.size(); ++i)
+        {
+            pool.Push(static_cast<unsigned>(i), [&, i](unsigned worker)
+            {
+                const auto [group, id] = files[i];
+                const EntryMetadata meta = index.Metadata(id);
+                const std::filesystem::path path = index.PathOf(id);
+                const FileKey key = KeyOf(path, meta);
+                std::uint64_t hash = 0;
+                if (!Lookup(key, full, hash, seen))
+                {
+                    if (!(full ? HashWhole(path, meta.size, buffers[worker], hash) : HashEdges(path, meta.size, buffers[worker], hash)))
+                        return;
+                    Remember(key, full, hash, seen);
+                }
+                hashed[i] = {group, hash, id};
+                read[i] = true;
+            });
+        }
+        pool.Run(keep_running);
+
+        std::vector<Hashed> sorted;
+        sorted.reserve(files.size());
+        for (std::size_t i = 0; i < files.size(); ++i)
+        {
+            if (read[i])
+                sorted.push_back(hashed[i]);
+        }
+        std::sort(sorted.begin(), sorted.end());
+
+        std::vector<DuplicateGroup> refined;
+        for (std::size_t begin = 0, end; begin < sorted.size(); begin = end)
+        {
+            end = begin + 1;
+            while (end < sorted.size() && sorted[end].group == sorted[begin].group && sorted[end].hash == sorted[begin].hash)
+                ++end;
+            if (end - begin < 2)
+                continue;
+            DuplicateGroup group{groups[sorted[begin].group].size, {}};
+            for (std::size_t i = begin; i < end; ++i)
+                group.files.push_back(sorted[i].id);
+            refined.push_back(std::move(group));
+        }
+        return refined;
+    }
+
+    std::vector<DuplicateGroup> DuplicateFinder::Find(const IndexStore &index, EntryId top, const std::atomic<bool> &keep_running)
+    {
+        {
+            std::lock_guard<std::mutex> lock(cache_mutex_);
+            ++finds_running_;
+        }
+        Cache seen;
+
+        // stage 1: sizes, straight from the index
+        std::vector<std::pair<std::uint64_t, EntryId>> by_size;
+        for (EntryId id : index.Subtree(top))
+        {
+            if (!index.IsDirectory(id) && index.Size(id) != 0)
+                by_size.emplace_back(index.Size(id), id);
+        }
+        std::sort(by_size.begin(), by_size.end());
+
+        std::vector<DuplicateGroup> groups;
+        for (std::size_t begin = 0, end; begin < by_size.size(); begin = end)
+        {
+            end = begin + 1;
+            while (end < by_size.size() && by_size[end].first == by_size[begin].first)
+                ++end;
+            if (end - begin < 2)
+                continue;
+            DuplicateGroup group{by_size[begin].first, {}};
+            for (std::size_t i = begin; i < end; ++i)
+                group.files.push_back(by_size[i].second);
+            groups.push_back(std::move(group));
+        }
+
+        // stage 2: both ends; files that small are compared whole by it
+        groups = Refine(index, groups, false, keep_running, seen);
+        if (!keep_running)
+        {
+            Keep(seen, false);
+            return {};
+        }
+
+        // stage 3: everything, for the groups the edges could not settle
+        std::vector<DuplicateGroup> settled;
+        std::vector<DuplicateGroup> unsettled;
+        for (DuplicateGroup &group : groups)
+            (group.size <= 2 * EDGE_BYTES ? settled : unsettled).push_back(std::move(group));
+        for (DuplicateGroup &group : Refine(index, unsettled, true, keep_running, seen))
+            settled.push_back(std::move(group));
+        Keep(seen, keep_running);
+        if (!keep_running)
+            return {};
+
+        std::sort(settled.begin(), settled.end(), [](const DuplicateGroup &a, const DuplicateGroup &b)
+                  { return Wasted(a) != Wasted(b) ? Wasted(a) > Wasted(b) : a.files.front() < b.files.front(); });
+        return settled;
+    }
+}
@@ -0,0 +1,101 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+#include "index_store.h"
+
+namespace fileindexer {
+
+    // files with identical contents
+    struct DuplicateGroup
+    {
+        std::uint64_t size;
+        std::vector<EntryId> files;
+    };
+
+    // Finds files with identical contents in stages, each one reading more
+    // of fewer files:
+    //
+    //   1. files are grouped by the size the index already has, and every
+    //      file with a size of its own is out without being opened;
+    //   2. the rest are grouped by a hash of their first and last 4 KB,
+    //      which tells most same-sized files apart;
+    //   3. what is left is hashed whole, in large sequential reads.
+    //
+    // Stages 2 and 3 run on a thread pool. Both hashes are XXH64 and are
+    // remembered per (device, inode, size, mtime), so running it again only reads
+    // the files that changed in between. What is remembered is what the
+    // last complete Find hashed or looked up; the rest is dropped then, so
+    // the cache does not grow with every file that ever changed. Files
+    // that cannot be read are left out, and so are empty ones.
+    class DuplicateFinder
+    {
+    public:
+        // Duplicates among the live files below top, the groups wasting the
+        // most bytes first. Returns nothing if keep_running turns false.
+        std::vector<DuplicateGroup> Find(const IndexStore& index, EntryId top, const std::atomic<bool>& keep_running);
+
+    private:
+        // Inodes are only unique within one device, and the tree below a
+        // root can span several, so the device is part of the key.
+        struct FileKey
+        {
+            std::uint64_t device;
+            std::uint64_t inode;
+            std::uint64_t size;
+            std::int64_t mtime;
+
+            bool operator==(const FileKey& other) const
+            {
+                return device == other.device && inode == other.inode && size == other.size && mtime == other.mtime;
+            }
+        };
+
+        struct FileKeyHash
+        {
+            std::size_t operator()(const FileKey& key) const
+            {
+                std::uint64_t h = key.inode * 0x9E3779B97F4A7C15ull;
+                h ^= key.device + 0x632BE59BD9B4E019ull + (h << 6) + (h >> 2);
+                h ^= key.size + 0x632BE59BD9B4E019ull + (h << 6) + (h >> 2);
+                h ^= static_cast<std::uint64_t>(key.mtime) + 0x632BE59BD9B4E019ull + (h << 6) + (h >> 2);
+                return static_cast<std::size_t>(h);
+            }
+        };
+
+        struct CachedHashes
+        {
+            std::uint64_t edges = 0;
+            std::uint64_t full = 0;
+            bool has_edges = false;
+            bool has_full = false;
+        };
+
+        using Cache = std::unordered_map<FileKey, CachedHashes, FileKeyHash>;
+
+        // The key of the file at path, which the index knows as meta; the
+        // inode is 0 if the file has none or cannot be looked at.
+        static FileKey KeyOf(const std::filesystem::path& path, const EntryMetadata& meta);
+        // Hashes every file in groups with the hash stage picks, and splits
+        // each group by it; groups left with one file are dropped. Every
+        // hash used goes into seen.
+        std::vector<DuplicateGroup> Refine(const IndexStore& index, const std::vector<DuplicateGroup>& groups, bool full,
+                                           const std::atomic<bool>& keep_running, Cache& seen);
+        bool Lookup(const FileKey& key, bool full, std::uint64_t& hash, Cache& seen);
+        void Remember(const FileKey& key, bool full, std::uint64_t hash, Cache& seen);
+        static void Note(CachedHashes& cached, bool full, std::uint64_t hash);
+        // seen replaces the cache after a complete Find that ran alone, and
+        // is merged into it otherwise
+        void Keep(Cache& seen, bool complete);
+
+        std::mutex cache_mutex_;
+        Cache cache_;
+        // Finds in progress; guarded by cache_mutex_
+        std::size_t finds_running_ = 0;
+    };
+}
@@ -7,11 +7,19 @@
 #include <chrono>
 #include <sys/stat.h>
 #include <unordered_map>
+#include <functional>
 #include "scoped_timer.h"
+#include "work_stealing_pool.h"
+#include "crawl_backend.h"
+#include "index_watcher.h"
+#include "search_engine.h"
+#include "content_index.h"
+#include "duplicate_finder.h"
 
 using json = nlohmann::json;
 
 #define COMPRESSION_LEVEL 1
+#define INDEX_FORMAT_VERSION 2
 #define DEBUG_MEASURE_TIMES 1
 
 #ifdef DEBUG_MEASURE_TIMES
@@ -22,6 +30,26 @@ using json = nlohmann::json;
 
 // ---------------- JSON Serialization ----------------
 
+// Timestamps are stored as raw file clock ticks in nanoseconds so a reloaded
+// entry compares exactly equal to a fresh stat of an untouched file.
+static int64_t ToNanoseconds(std::filesystem::file_time_type t)
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(t.time_since_epoch()).count();
+}
+
+static std::filesystem::file_time_type FromNanoseconds(int64_t ns)
+{
+    return std::filesystem::file_time_type(
+        std::chrono::duration_cast<std::filesystem::file_time_type::duration>(std::chrono::nanoseconds(ns)));
+}
+
+// LoadFromFile turns away files older than INDEX_FORMAT_VERSION, so every
+// entry read here carries mtime_ns.
+static std::filesystem::file_time_type ReadModifiedTime(const json &j)
+{
+    return FromNanoseconds(j.at("mtime_ns").get<int64_t>());
+}
+
 void fileindexer::IndexedFile::to_json(json &j) const
 {
     j = json{
@@ -29,9 +57,9 @@ void fileindexer::IndexedFile::to_json(json &j) const
         {"path", path.string()},
         {"size", size},
         {"extension", extension},
-        {"last_modified", std::chrono::duration_cast<std::chrono::seconds>(
-                              last_modified.time_since_epoch())
-                              .count()}
+        {"mtime_ns", ToNanoseconds(last_modified)},
+        {"ctime_ns", change_time_ns},
+        {"inode", inode}
     };
 }
 
@@ -41,8 +69,10 @@ void fileindexer::IndexedFile::from_json(const json &j)
     path = j.at("path").get<std::string>();
     size = j.at("size").get<std::uintmax_t>();
     extension = j.value("extension", "");
-    auto secs = j.at("last_modified").get<uint64_t>();
-    last_modified = std::filesystem::file_time_type(std::chrono::seconds(secs));
+    extension_type = GetExtensionType(path);
+    last_modified = ReadModifiedTime(j);
+    change_time_ns = j.value("ctime_ns", int64_t(0));
+    inode = j.value("inode", uint64_t(0));
 }
 
 void fileindexer::IndexedDirectory::to_json(json &j) const
@@ -51,9 +81,9 @@ void fileindexer::IndexedDirectory::to_json(json &j) const
         {"name", name},
         {"path", path.string()},
         {"size", size},
-        {"last_modified", std::chrono::duration_cast<std::chrono::seconds>(
-                              last_modified.time_since_epoch())
-                              .count()}
+        {"mtime_ns", ToNanoseconds(last_modified)},
+        {"ctime_ns", change_time_ns},
+        {"inode", inode}
     };
 }
 
@@ -62,17 +92,20 @@ void fileindexer::IndexedDirectory::from_json(const json &j)
     name = j.at("name").get<std::string>();
     path = j.at("path").get<std::string>();
     size = j.at("size").get<std::uintmax_t>();
-    auto secs = j.at("last_modified").get<uint64_t>();
-    last_modified = std::filesystem::file_time_type(std::chrono::seconds(secs));
+    last_modified = ReadModifiedTime(j);
+    change_time_ns = j.value("ctime_ns", int64_t(0));
+    inode = j.value("inode", uint64_t(0));
 }
 
-// small RAII guard to always reset the indexing flag
+// small RAII guard to always reset the indexing flag; raise = false for
+// flags the caller already set before starting the thread
 struct IndexingGuard
 {
     std::atomic<bool> &flag;
-    explicit IndexingGuard(std::atomic<bool> &f) : flag(f)
+    explicit IndexingGuard(std::atomic<bool> &f, bool raise = true) : flag(f)
     {
-        flag = true;
+        if (raise)
+            flag = true;
     }
     ~IndexingGuard()
     {
@@ -86,12 +119,90 @@ namespace fileindexer
 {
     namespace
     {
-        std::unordered_map<std::filesystem::path, IndexedFile> file_index;
-        std::unordered_map<std::filesystem::path, IndexedDirectory> dir_index;
+        // The published index. Readers copy the pointer and keep that version
+        // alive for as long as they look at it; writers build the next version
+        // on the side and swap it in, so nobody waits on a crawl to read.
+        IndexSnapshot current_index = std::make_shared<const IndexStore>();
 
         std::thread index_thread;
         std::atomic<bool> indexing{false};
+        // serializes writers only, so no update is built on a stale version
         std::mutex index_mutex;
+
+        CrawlOptions crawl_options;
+        std::mutex options_mutex;
+
+        IndexWatcher index_watcher;
+
+        NameSearch file_search{false};
+        NameSearch directory_search{true};
+        ContentSearch content_search;
+
+        // the word index over text files, published whole like the index
+        std::shared_ptr<const ContentIndex> content_index = std::make_shared<const ContentIndex>();
+        std::thread content_index_thread;
+        std::atomic<bool> content_indexing{false};
+
+        DuplicateFinder duplicate_finder;
+        // cleared on shutdown so a long duplicate search stops early
+        std::atomic<bool> keep_finding{true};
+
+        // Records refer to their directory by (worker << 32 | record index) until
+        // the merge hands out real ids; the crawl root has no record of its own.
+        constexpr std::uint64_t ROOT_REF = ~std::uint64_t(0);
+
+        // the name hash is taken once here and reused by every later lookup
+        struct CrawlRecord
+        {
+            std::uint32_t name_offset;
+            std::uint16_t name_length;
+            bool is_directory;
+            std::uint64_t name_hash;
+            EntryMetadata meta;
+        };
+
+        // the children of one listed directory, contiguous in a worker's records
+        struct CrawlBlock
+        {
+            std::uint64_t dir_ref;
+            std::uint32_t first;
+            std::uint32_t count;
+        };
+
+        // Append-only records from one crawler worker. Names go into the
+        // worker's own arena; nothing is keyed or linked until the merge.
+        struct CrawlOutput
+        {
+            StringArena names;
+            std::vector<CrawlRecord> records;
+            std::vector<CrawlBlock> blocks;
+        };
+
+        // a subdirectory waiting to be crawled; unchanged means its mtime
+        // matched the cache and it does not need to be listed
+        struct PendingDirectory
+        {
+            std::filesystem::path path;
+            std::uint64_t ref;
+            EntryId cached; // the same directory in the cache, if it was there
+            bool unchanged;
+        };
+    }
+
+    IndexSnapshot Snapshot()
+    {
+        return std::atomic_load(&current_index);
+    }
+
+    // Makes next the current index with the following generation number.
+    // Caller holds index_mutex.
+    void Publish(IndexStore next)
+    {
+        // stores copied from a snapshot keep their orders current already
+        if (!next.HasOrders())
+            next.BuildOrders();
+        next.SetGeneration(Snapshot()->Generation() + 1);
+        std::atomic_store(&current_index, IndexSnapshot(std::make_shared<const IndexStore>(std::move(next))));
     }
 
     std::uintmax_t GetDirectorySize(const std::filesystem::path &dir)
@@ -140,107 +251,224 @@ namespace fileindexer
         return std::string(buf);
     }
 
-    void IndexDirectory(
-        const std::filesystem::path &directory,
-        std::unordered_map<std::filesystem::path, IndexedFile> &files_out,
-        std::unordered_map<std::filesystem::path, IndexedDirectory> &dirs_out,
-        std::unordered_map<std::filesystem::path, IndexedFile> &files_from_disk,
-        std::unordered_map<std::filesystem::path, IndexedDirectory> &dirs_from_disk,
-        bool recursive = true)
+    unsigned ResolveCrawlerThreads()
     {
-        MEASURE_TIME("IndexDirectory");
+        unsigned threads = GetCrawlOptions().threads;
+        if (threads > 0)
+            return threads;
 
-        files_out.clear();
-        dirs_out.clear();
+        // listing is syscall bound, so oversubscribe to keep the device queue full
+        unsigned hw = std::thread::hardware_concurrency();
+        return std::clamp(hw * 2, 2u, 64u);
+    }
 
-        std::error_code ec;
+    EntryMetadata ToMetadata(const DirEntryInfo &entry)
+    {
+        return {entry.size, ToNanoseconds(entry.last_modified), entry.change_time_ns, entry.inode};
+    }
 
-        auto iterator = std::filesystem::directory_iterator(directory, std::filesystem::directory_options::skip_permission_denied, ec);
+    // Exact fingerprint match: any difference in mtime, ctime or inode (and
+    // size, for files) means the entry changed, including mtimes going back.
+    // A directory's recorded size is the recursive total, not its st_size.
+    bool IsUnchanged(const IndexStore &cache, EntryId id, const DirEntryInfo &current)
+    {
+        EntryMetadata cached = cache.Metadata(id);
+        return cached.mtime == ToNanoseconds(current.last_modified) &&
+               cached.inode == current.inode &&
+               cached.ctime_ns == current.change_time_ns &&
+               (cache.IsDirectory(id) || cached.size == current.size);
+    }
 
-        if (ec)
-        {
-            std::cerr << "Error opening directory: " << directory << " - " << ec.message() << "\n";
-            return;
-        }
+    std::uint64_t EmitRecord(CrawlOutput &out, unsigned worker, std::string_view name, std::uint64_t name_hash, bool is_directory, const EntryMetadata &meta)
+    {
+        auto index = out.records.size();
+        out.records.push_back({out.names.Append(name), static_cast<std::uint16_t>(name.size()), is_directory, name_hash, meta});
+        return (static_cast<std::uint64_t>(worker) << 32) | index;
+    }
 
-        try {
-            for (const auto& entry : iterator)
-            {
-                if (!indexing) return;
+    // Records a subdirectory found while scanning and decides whether the
+    // crawler has to list it again or can carry its cached contents over.
+    void EmitDirectory(
+        const PendingDirectory &parent,
+        const DirEntryInfo &entry,
+        CrawlOutput &out,
+        unsigned worker,
+        const IndexStore &cache,
+        bool incremental,
+        std::vector<PendingDirectory> &subdirs_out)
+    {
+        auto path = parent.path / entry.name;
+        const std::uint64_t name_hash = HashName(entry.name);
+
+        EntryId cached = INVALID_ENTRY;
+        if (parent.cached != INVALID_ENTRY)
+            cached = cache.FindChild(parent.cached, entry.name, name_hash);
+        else if (incremental && path == cache.RootPath())
+            cached = ROOT_ENTRY; // crawling above the cached tree
+        if (cached != INVALID_ENTRY && !cache.IsDirectory(cached))
+            cached = INVALID_ENTRY;
+
+        bool unchanged = cached != INVALID_ENTRY && IsUnchanged(cache, cached, entry);
+        std::uint64_t ref = EmitRecord(out, worker, entry.name, name_hash, true, ToMetadata(entry));
+        subdirs_out.push_back({std::move(path), ref, cached, incremental && unchanged});
+    }
 
-                const auto& path = entry.path();
-                const std::string filename = path.filename().string();
+    // Lists one directory level into the worker's records and returns the
+    // subdirectories that still have to be crawled.
+    void ScanDirectory(
+        CrawlBackend backend,
+        const PendingDirectory &pending,
+        CrawlOutput &out,
+        unsigned worker,
+        const IndexStore &cache,
+        bool incremental,
+        const std::atomic<bool> &keep_running,
+        std::vector<PendingDirectory> &subdirs_out)
+    {
+        auto first = static_cast<std::uint32_t>(out.records.size());
 
-                // Skip our index files
-                if (filename.rfind(".index", 0) == 0)
-                    continue;
+        ListDirectory(backend, pending.path, [&](const DirEntryInfo &entry)
+        {
+            if (!keep_running) return false;
 
-                ec.clear();
+            // Skip our index files
+            if (entry.name.rfind(".index", 0) == 0)
+                return true;
 
-                if (entry.is_directory(ec) && !ec)
-                {
-                    auto mod_time = entry.last_write_time(ec);
-                    if (ec) continue;
+            if (entry.is_directory)
+                EmitDirectory(pending, entry, out, worker, cache, incremental, subdirs_out);
+            else
+                EmitRecord(out, worker, entry.name, HashName(entry.name), false, ToMetadata(entry));
+            return true;
+        });
 
-                    auto it = dirs_from_disk.find(path);
+        out.blocks.push_back({pending.ref, first, static_cast<std::uint32_t>(out.records.size()) - first});
+    }
 
-                    if (it != dirs_from_disk.end() && mod_time <= it->second.last_modified)
-                    {
-                        dirs_out[path] = it->second; // reuse cached
-                        continue;
-                    }
+    // A directory whose mtime matches the cache has the same set of names, so
+    // its cached files are copied over as-is and only its subdirectories are
+    // stat'ed to find out which of them changed. No readdir happens here.
+    void CarryOverDirectory(
+        CrawlBackend backend,
+        const PendingDirectory &pending,
+        CrawlOutput &out,
+        unsigned worker,
+        const IndexStore &cache,
+        const std::atomic<bool> &keep_running,
+        std::vector<PendingDirectory> &subdirs_out)
+    {
+        auto first = static_cast<std::uint32_t>(out.records.size());
+        std::vector<std::string> names;
 
-                    IndexedDirectory dir;
-                    dir.name = filename;
-                    dir.path = path;
-                    dir.last_modified = mod_time;
-                    //dir.size = GetDirectorySize(path);
+        for (EntryId child = cache.FirstChild(pending.cached); child != INVALID_ENTRY; child = cache.NextSibling(child))
+        {
+            if (cache.IsDirectory(child))
+                names.emplace_back(cache.Name(child));
+            else
+                EmitRecord(out, worker, cache.Name(child), cache.NameHash(child), false, cache.Metadata(child));
+        }
 
-                    dirs_out[path] = dir;
-                    dirs_from_disk[path] = dir;
+        if (!names.empty())
+        {
+            StatEntries(backend, pending.path, names, [&](const DirEntryInfo &entry)
+            {
+                if (!keep_running) return false;
+                if (entry.is_directory)
+                    EmitDirectory(pending, entry, out, worker, cache, true, subdirs_out);
+                return true;
+            });
+        }
 
-                    if (recursive)
-                    {
-                        std::unordered_map<std::filesystem::path, IndexedFile> sub_files;
-                        std::unordered_map<std::filesystem::path, IndexedDirectory> sub_dirs;
-                        IndexDirectory(path, sub_files, sub_dirs, files_from_disk, dirs_from_disk, recursive);
-                        files_out.insert(sub_files.begin(), sub_files.end());
-                        dirs_out.insert(sub_dirs.begin(), sub_dirs.end());
-                    }
-                }
-                else if (entry.is_regular_file(ec) && !ec)
-                {
-                    auto mod_time = entry.last_write_time(ec);
-                    if (ec) continue;
+        out.blocks.push_back({pending.ref, first, static_cast<std::uint32_t>(out.records.size()) - first});
+    }
 
-                    auto it = files_from_disk.find(path);
+    // Turns the worker records into a store, breadth first from the root, so a
+    // directory's children get consecutive ids and every parent precedes its
+    // children. Directory sizes are summed bottom-up afterwards.
+    IndexStore MergeCrawlOutputs(const std::filesystem::path &root, std::vector<CrawlOutput> &outputs)
+    {
+        // where each listed directory's block lives: the output of the worker
+        // that listed it, not necessarily the one that found the directory
+        std::size_t total = 1;
+        std::unordered_map<std::uint64_t, std::pair<unsigned, std::size_t>> block_of;
+        for (unsigned worker = 0; worker < outputs.size(); ++worker)
+        {
+            total += outputs[worker].records.size();
+            for (std::size_t b = 0; b < outputs[worker].blocks.size(); ++b)
+                block_of.emplace(outputs[worker].blocks[b].dir_ref, std::make_pair(worker, b));
+        }
 
-                    if (it != files_from_disk.end() && mod_time <= it->second.last_modified)
-                    {
-                        files_out[path] = it->second; // reuse cached
-                        continue;
-                    }
+        IndexStore store;
+        store.Reset(root);
+        store.Reserve(total);
 
-                    IndexedFile file;
-                    file.name = filename;
-                    file.path = path;
-                    file.size = entry.file_size(ec);
-                    file.extension = path.extension().string();
-                    file.extension_type = GetExtensionType(path);
-                    file.last_modified = mod_time;
-
-                    if (!ec)
-                    {
-                        files_out[path] = file;
-                        files_from_disk[path] = file;
-                    }
-                }
+        std::vector<std::pair<std::uint64_t, EntryId>> queue;
+        queue.emplace_back(ROOT_REF, ROOT_ENTRY);
+        for (std::size_t head = 0; head < queue.size(); ++head)
+        {
+            auto [ref, id] = queue[head];
+            auto it = block_of.find(ref);
+            if (it == block_of.end())
+                continue; // never listed, the crawl was cut short
+
+            auto [worker, b] = it->second;
+            const CrawlOutput &owner = outputs[worker];
+            const CrawlBlock &block = owner.blocks[b];
+            for (std::uint32_t i = block.first; i < block.first + block.count; ++i)
+            {
+                const CrawlRecord &record = owner.records[i];
+                EntryId child = store.Add(id, owner.names.View(record.name_offset, record.name_length), record.name_hash, record.is_directory, record.meta);
+                if (record.is_directory)
+                    queue.emplace_back((static_cast<std::uint64_t>(worker) << 32) | i, child);
             }
         }
-        catch (const std::exception& e)
+
+        store.AccumulateSizes();
+        return store;
+    }
+
+    // Crawls the tree on a work-stealing pool: every subdirectory is its own
+    // task, so wide and deep trees both keep all workers busy. In incremental
+    // mode a directory is only re-listed when its own mtime moved; unchanged
+    // ones carry their cached children over and cost a stat per subdirectory.
+    // Returns a store rooted at directory with recursive directory sizes.
+    IndexStore IndexDirectory(
+        const std::filesystem::path &directory,
+        const IndexStore &cache,
+        const std::atomic<bool> &keep_running)
+    {
+        const CrawlOptions options = GetCrawlOptions();
+        const CrawlBackend backend = options.backend;
+        const bool incremental = options.incremental && !cache.Empty();
+        MEASURE_TIME(std::string("IndexDirectory [") + CrawlBackendName(backend) + (incremental ? ", incremental]" : "]"));
+
+        WorkStealingPool pool(ResolveCrawlerThreads());
+        std::vector<CrawlOutput> outputs(pool.ThreadCount());
+
+        std::function<void(const PendingDirectory &, unsigned)> crawl =
+            [&](const PendingDirectory &pending, unsigned worker)
         {
-            std::cerr << "Error during indexing: " << e.what() << "\n";
-        }
+            std::vector<PendingDirectory> subdirs;
+            if (pending.unchanged)
+                CarryOverDirectory(backend, pending, outputs[worker], worker, cache, keep_running, subdirs);
+            else
+                ScanDirectory(backend, pending, outputs[worker], worker, cache, incremental, keep_running, subdirs);
+
+            for (auto &sub : subdirs)
+            {
+                pool.Push(worker, [&crawl, sub = std::move(sub)](unsigned w)
+                          { crawl(sub, w); });
+            }
+        };
+
+        // the root's own fingerprint is not tracked by a crawl, so it is always listed
+        EntryId cached_root = incremental ? cache.Find(directory) : INVALID_ENTRY;
+        pool.Push(0, [&crawl, &directory, cached_root](unsigned w)
+                  { crawl(PendingDirectory{directory, ROOT_REF, cached_root, false}, w); });
+        pool.Run(keep_running);
+        ReleasePrefetchedDirectories();
+
+        return MergeCrawlOutputs(directory, outputs);
     }
 
     EXTENSION_TYPE GetExtensionType(std::filesystem::path path)
@@ -281,10 +509,20 @@ namespace fileindexer
         return indexing;
     }
 
+    void SetCrawlOptions(const CrawlOptions &options)
+    {
+        std::lock_guard<std::mutex> lock(options_mutex);
+        crawl_options = options;
+    }
+
+    CrawlOptions GetCrawlOptions()
+    {
+        std::lock_guard<std::mutex> lock(options_mutex);
+        return crawl_options;
+    }
+
     bool LoadFromFile(const std::string &path)
     {
-        std::lock_guard<std::mutex> lock(index_mutex);
-        
         const std::string jsonFilePath = path + "/.index";
         std::ifstream in(jsonFilePath, std::ios::binary);
 
@@ -293,21 +531,65 @@ namespace fileindexer
             try
             {
                 json j = json::parse(content);
-                file_index.clear();
-                dir_index.clear();
-                
-                for (const auto &f : j["files"])
+
+                // older layouts lack fields or mean other things by them (mtimes
+                // in whole seconds), so they are crawled afresh, not guessed at
+                const int version = j.value("version", 0);
+                if (version != INDEX_FORMAT_VERSION)
                 {
-                    IndexedFile file;
-                    file.from_json(f);
-                    file_index[file.path] = std::move(file);
+                    std::cerr << "Index format version " << version << " is not " << INDEX_FORMAT_VERSION
+                              << ", ignoring " << jsonFilePath << "\n";
+                    return false;
                 }
+
+                std::vector<IndexedDirectory> dirs;
                 for (const auto &d : j["dirs"])
                 {
                     IndexedDirectory dir;
                     dir.from_json(d);
-                    dir_index[dir.path] = std::move(dir);
+                    dirs.push_back(std::move(dir));
                 }
+                // a parent path is a strict prefix of its children's, so
+                // shorter paths first means parents go in before children
+                std::sort(dirs.begin(), dirs.end(), [](const IndexedDirectory &a, const IndexedDirectory &b)
+                          { return a.path.native().size() < b.path.native().size(); });
+
+                IndexStore store;
+                store.Reset(j.value("root", path));
+                store.Reserve(1 + dirs.size() + j["files"].size());
+
+                // entries were saved directory by directory, so consecutive
+                // ones mostly share a parent and the walk from the root is
+                // only repeated when the parent changes
+                std::filesystem::path last_parent;
+                EntryId last_parent_id = INVALID_ENTRY;
+                auto add = [&](const std::filesystem::path &p, bool is_directory, const EntryMetadata &meta)
+                {
+                    auto parent_path = p.parent_path();
+                    if (last_parent_id == INVALID_ENTRY || parent_path.native() != last_parent.native())
+                    {
+                        last_parent_id = store.Find(parent_path);
+                        last_parent = std::move(parent_path);
+                    }
+                    const std::string name = p.filename().native();
+                    const std::uint64_t name_hash = HashName(name);
+                    if (last_parent_id != INVALID_ENTRY && store.FindChild(last_parent_id, name, name_hash) == INVALID_ENTRY)
+                        store.Add(last_parent_id, name, name_hash, is_directory, meta);
+                };
+
+                for (const auto &dir : dirs)
+                    add(dir.path, true, {0, ToNanoseconds(dir.last_modified), dir.change_time_ns, dir.inode});
+                for (const auto &f : j["files"])
+                {
+                    IndexedFile file;
+                    file.from_json(f);
+                    add(file.path, false, {file.size, ToNanoseconds(file.last_modified), file.change_time_ns, file.inode});
+                }
+
+                store.AccumulateSizes();
+
+                std::lock_guard<std::mutex> lock(index_mutex);
+                Publish(std::move(store));
                 return true;
             }
             catch (const std::exception &e)
@@ -353,87 +635,63 @@ namespace fileindexer
         return parse_and_fill(std::string(decompressed.data(), decompressed.data() + dSize));
     }
 
-    std::vector<IndexedFile> SearchFiles(const std::string &query)
+    SearchResults FindFiles(const std::string &query, std::size_t limit, MatchMode mode)
     {
-        std::vector<IndexedFile> results;
-        std::lock_guard<std::mutex> lock(index_mutex);
-
-        auto to_lower = [](const std::string &s)
-        {
-            std::string lower;
-            lower.reserve(s.size());
-            std::transform(s.begin(), s.end(), std::back_inserter(lower),
-                           [](unsigned char c)
-                           { return static_cast<char>(std::tolower(c)); });
-            return lower;
-        };
-
-        std::string lower_query = to_lower(query);
-
-        for (const auto &[_, file] : file_index)
-        {
-            if (to_lower(file.name).find(lower_query) != std::string::npos)
-            {
-                results.push_back(file);
-            }
-        }
-
-        return results;
+        IndexSnapshot index = Snapshot();
+        std::vector<EntryId> ids = file_search.Run(*index, ParseSearchQuery(query), limit, mode);
+        return SearchResults(std::move(index), std::move(ids));
     }
 
-    std::vector<IndexedDirectory> SearchDirectories(const std::string &query)
+    SearchResults FindDirectories(const std::string &query, std::size_t limit, MatchMode mode)
     {
-        std::vector<IndexedDirectory> results;
-        std::lock_guard<std::mutex> lock(index_mutex);
-
-        auto to_lower = [](const std::string &s)
-        {
-            std::string lower;
-            lower.reserve(s.size());
-            std::transform(s.begin(), s.end(), std::back_inserter(lower),
-                           [](unsigned char c)
-                           { return static_cast<char>(std::tolower(c)); });
-            return lower;
-        };
-
-        std::string lower_query = to_lower(query);
+        IndexSnapshot index = Snapshot();
+        std::vector<EntryId> ids = directory_search.Run(*index, ParseSearchQuery(query), limit, mode);
+        return SearchResults(std::move(index), std::move(ids));
+    }
 
-        for (const auto &[_, dir] : dir_index)
-        {
-            if (to_lower(dir.name).find(lower_query) != std::string::npos)
-            {
-                results.push_back(dir);
-            }
-        }
+    std::vector<IndexedFile> SearchFiles(const std::string &query, std::size_t limit, MatchMode mode)
+    {
+        const SearchResults results = FindFiles(query, limit, mode);
+        return results.Files(0, results.Size());
+    }
 
-        return results;
+    std::vector<IndexedDirectory> SearchDirectories(const std::string &query, std::size_t limit, MatchMode mode)
+    {
+        const SearchResults results = FindDirectories(query, limit, mode);
+        return results.Directories(0, results.Size());
     }
 
     void SaveToFile(const std::string &path)
     {
-        std::lock_guard<std::mutex> lock(index_mutex);
+        const IndexSnapshot index = Snapshot();
 
-        if (file_index.empty() && dir_index.empty())
+        if (index->FileCount() == 0 && index->DirectoryCount() == 0)
         {
             std::cerr << "SaveToFile: Skipping save because index is empty.\n";
             return;
         }
 
         json j;
+        j["version"] = INDEX_FORMAT_VERSION;
+        j["root"] = index->RootPath().string();
         j["files"] = json::array();
         j["dirs"] = json::array();
 
-        for (const auto &[_, file] : file_index)
-        {
-            json f;
-            file.to_json(f);
-            j["files"].push_back(f);
-        }
-        for (const auto &[_, dir] : dir_index)
+        for (EntryId id = 1; id < index->Capacity(); ++id)
         {
-            json d;
-            dir.to_json(d);
-            j["dirs"].push_back(d);
+            if (!index->IsLive(id))
+                continue;
+            json e;
+            if (index->IsDirectory(id))
+            {
+                index->MaterializeDirectory(id).to_json(e);
+                j["dirs"].push_back(std::move(e));
+            }
+            else
+            {
+                index->MaterializeFile(id).to_json(e);
+                j["files"].push_back(std::move(e));
+            }
         }
 
         const std::string base = path + "/.index";
@@ -503,55 +761,337 @@ namespace fileindexer
         }
     }
 
-    std::tuple<std::unordered_map<std::filesystem::path, IndexedDirectory>,
-               std::unordered_map<std::filesystem::path, IndexedFile>>
-    ShowFilesAndDirsContinuous(const std::filesystem::path &path)
+    // ---------------- Live index maintenance ----------------
+
+    // The helpers below edit the unpublished next version of the index.
+    // Callers hold index_mutex.
+
+    // Applies a size change to id and every directory above it.
+    void PropagateSize(IndexStore &store, EntryId id, std::intmax_t delta)
     {
-        std::cout << "running this motherfucker rn: " <<  path << std::endl;
-        IndexingGuard guard(indexing);
+        if (delta == 0)
+            return;
+        for (EntryId at = id; at != INVALID_ENTRY; at = store.Parent(at))
+            store.AddSize(at, delta);
+    }
 
-        std::unordered_map<std::filesystem::path, IndexedFile> files_from_disk;
-        std::unordered_map<std::filesystem::path, IndexedDirectory> dirs_from_disk;
-        
-        // Load existing index if available
+    std::intmax_t SizeDelta(std::uintmax_t before, std::uintmax_t after)
+    {
+        return static_cast<std::intmax_t>(after) - static_cast<std::intmax_t>(before);
+    }
+
+    // Incrementally reindexes everything below dir, splices the result into
+    // store and watches any directory that is new.
+    void RescanSubtree(IndexStore &store, const std::filesystem::path &dir)
+    {
+        const auto &keep_running = index_watcher.KeepRunning();
+
+        EntryId at = store.Find(dir);
+        if (at == INVALID_ENTRY)
+            return;
+
+        IndexStore sub = IndexDirectory(dir, store, keep_running);
+        if (!keep_running)
+            return;
+
+        for (EntryId id = 1; id < sub.Capacity(); ++id)
+        {
+            if (sub.IsLive(id) && sub.IsDirectory(id))
+                index_watcher.Watch(sub.PathOf(id));
+        }
+
+        if (at == ROOT_ENTRY)
+        {
+            // the whole tree was redone; take it as is instead of splicing
+            sub.SetMetadata(ROOT_ENTRY, store.Metadata(ROOT_ENTRY));
+            store = std::move(sub);
+            return;
+        }
+
+        PropagateSize(store, at, SizeDelta(store.Size(at), sub.Size(ROOT_ENTRY)));
+        store.RemoveSubtree(at, true);
+        store.Graft(at, sub);
+    }
+
+    // Removes id and everything below it, taking its size off its ancestors.
+    void EraseEntry(IndexStore &store, EntryId id)
+    {
+        PropagateSize(store, store.Parent(id), SizeDelta(store.Size(id), 0));
+        if (store.IsDirectory(id))
+            index_watcher.Unwatch(store.PathOf(id));
+        store.RemoveSubtree(id);
+    }
+
+    // Renames an indexed entry in place: one relink in the tree, and whatever
+    // sits below it comes along untouched.
+    bool MoveEntry(IndexStore &store, const std::filesystem::path &from, const std::filesystem::path &to)
+    {
+        EntryId id = store.Find(from);
+        EntryId new_parent = store.Find(to.parent_path());
+        if (id == INVALID_ENTRY || new_parent == INVALID_ENTRY)
+            return false;
+
+        const std::string name = to.filename().string();
+        EntryId replaced = store.FindChild(new_parent, name);
+        if (replaced == id)
+            return true;
+
+        // a directory it replaces lost its watches when the watcher paired
+        // the rename (RenameWatches), before this batch was handed over
+        EntryId old_parent = store.Parent(id);
+        std::uintmax_t size = store.Size(id);
+        std::uintmax_t replaced_size = replaced != INVALID_ENTRY ? store.Size(replaced) : 0;
+        if (!store.Move(id, new_parent, name))
+            return false;
+
+        PropagateSize(store, old_parent, SizeDelta(size, 0));
+        PropagateSize(store, new_parent, SizeDelta(replaced_size, size));
+        return true;
+    }
+
+    void ApplyWatchBatch(std::vector<WatchEvent> &batch)
+    {
+        const CrawlBackend backend = GetCrawlOptions().backend;
+        std::vector<std::filesystem::path> parents;
+
+        // Readers stay on the current version until the whole batch is in.
+        // The copy shares every chunk with it and clones only what the
+        // batch touches.
         std::lock_guard<std::mutex> lock(index_mutex);
-        for (const auto& [p, f] : file_index) {
-            files_from_disk[p] = f;
+        IndexStore store = *Snapshot();
+
+        for (auto &event : batch)
+        {
+            if (!index_watcher.IsRunning())
+                return;
+
+            if (event.kind == WatchEvent::RESCAN)
+            {
+                RescanSubtree(store, event.path);
+                continue;
+            }
+
+            // after a successful move the entry is refreshed below like any
+            // change; if the source was never indexed it is simply new
+            if (event.kind == WatchEvent::MOVED)
+            {
+                if (MoveEntry(store, event.from, event.path))
+                    parents.push_back(event.from.parent_path());
+                else
+                    event.kind = WatchEvent::CREATED;
+            }
+
+            const auto parent = event.path.parent_path();
+            const std::string name = event.path.filename().string();
+
+            // Skip our index files
+            if (name.rfind(".index", 0) == 0)
+                continue;
+
+            EntryId parent_id = store.Find(parent);
+            if (parent_id == INVALID_ENTRY)
+                continue;
+            const std::uint64_t name_hash = HashName(name);
+            EntryId existing = store.FindChild(parent_id, name, name_hash);
+
+            bool found = false;
+            StatEntries(backend, parent, {name}, [&](const DirEntryInfo &entry)
+            {
+                found = true;
+
+                // the name changed kind, so the old entry goes entirely
+                if (existing != INVALID_ENTRY && store.IsDirectory(existing) != entry.is_directory)
+                {
+                    EraseEntry(store, existing);
+                    existing = INVALID_ENTRY;
+                }
+
+                if (entry.is_directory)
+                {
+                    bool known = existing != INVALID_ENTRY;
+                    if (known)
+                        store.SetMetadata(existing, ToMetadata(entry));
+                    else
+                        store.Add(parent_id, name, name_hash, true, ToMetadata(entry));
+
+                    // a new directory may have been filled before its watch existed
+                    if (event.kind == WatchEvent::CREATED || !known)
+                    {
+                        index_watcher.Watch(event.path);
+                        RescanSubtree(store, event.path);
+                    }
+                }
+                else
+                {
+                    std::uintmax_t old_size = 0;
+                    if (existing != INVALID_ENTRY)
+                    {
+                        old_size = store.Size(existing);
+                        store.SetMetadata(existing, ToMetadata(entry));
+                    }
+                    else
+                    {
+                        store.Add(parent_id, name, name_hash, false, ToMetadata(entry));
+                    }
+                    PropagateSize(store, parent_id, SizeDelta(old_size, entry.size));
+                }
+                return false;
+            });
+
+            if (!found && existing != INVALID_ENTRY)
+                EraseEntry(store, existing);
+
+            parents.push_back(parent);
         }
-        for (const auto& [p, d] : dir_index) {
-            dirs_from_disk[p] = d;
+
+        // keep directory mtimes current so the next incremental crawl can
+        // carry these directories over instead of re-listing them
+        std::sort(parents.begin(), parents.end());
+        parents.erase(std::unique(parents.begin(), parents.end()), parents.end());
+        for (const auto &parent : parents)
+        {
+            EntryId id = store.Find(parent);
+            if (id == INVALID_ENTRY)
+                continue;
+            StatEntries(backend, parent.parent_path(), {parent.filename().string()}, [&](const DirEntryInfo &entry)
+            {
+                store.SetMetadata(id, ToMetadata(entry));
+                return false;
+            });
         }
 
-        std::unordered_map<std::filesystem::path, IndexedFile> files;
+        // removals only mark entries dead; rebuild once they outnumber the living
+        if (store.DeadCount() > store.FileCount() + store.DirectoryCount())
+            store = store.Compacted();
+
+        Publish(std::move(store));
+    }
+
+    // Puts inotify watches on root and every indexed directory below it. From
+    // here on the index follows the filesystem without further crawls.
+    void WatchIndexedTree(const std::filesystem::path &root)
+    {
+        if (!index_watcher.Start(root, ApplyWatchBatch))
+            return;
+
+        const IndexSnapshot index = Snapshot();
+        const EntryId top = index->Find(root);
+        if (top == INVALID_ENTRY)
+            return;
+        std::vector<EntryId> dirs{top};
+        for (EntryId id : index->Subtree(top))
+        {
+            if (index->IsDirectory(id))
+                dirs.push_back(id);
+        }
+
+        std::vector<std::filesystem::path> paths;
+        paths.reserve(dirs.size());
+        for (EntryId id : dirs)
+        {
+            paths.push_back(index->PathOf(id));
+            index_watcher.Watch(paths.back());
+        }
+
+        // Entries added, removed or renamed between a directory's listing
+        // and its watch going live changed its mtime; only those
+        // directories are listed again, not the tree that was just crawled.
+        for (std::size_t i = 0; i < dirs.size(); ++i)
+        {
+            std::error_code ec;
+            const auto mtime = std::filesystem::last_write_time(paths[i], ec);
+            if (ec || ToNanoseconds(mtime) != index->ModifiedNs(dirs[i]))
+                index_watcher.RequestRescan(paths[i]);
+        }
+    }
+
+    bool IsWatched(const std::filesystem::path &path)
+    {
+        return index_watcher.IsRunning() && IsWithin(path, index_watcher.Root());
+    }
+
+    // Materializes everything below top for the UI.
+    std::tuple<std::unordered_map<std::filesystem::path, IndexedDirectory>,
+               std::unordered_map<std::filesystem::path, IndexedFile>>
+    MaterializeSubtree(const IndexStore &index, EntryId top)
+    {
         std::unordered_map<std::filesystem::path, IndexedDirectory> dirs;
+        std::unordered_map<std::filesystem::path, IndexedFile> files;
+        for (EntryId id : index.Subtree(top))
+        {
+            if (index.IsDirectory(id))
+            {
+                auto dir = index.MaterializeDirectory(id);
+                auto key = dir.path;
+                dirs.emplace(std::move(key), std::move(dir));
+            }
+            else
+            {
+                auto file = index.MaterializeFile(id);
+                auto key = file.path;
+                files.emplace(std::move(key), std::move(file));
+            }
+        }
+        return {std::move(dirs), std::move(files)};
+    }
+
+    std::tuple<std::unordered_map<std::filesystem::path, IndexedDirectory>,
+               std::unordered_map<std::filesystem::path, IndexedFile>>
+    ShowFilesAndDirsContinuous(const std::filesystem::path &path)
+    {
+        // the live index already covers this path, no crawl needed
+        if (IsWatched(path))
+        {
+            const IndexSnapshot index = Snapshot();
+            return MaterializeSubtree(*index, index->Find(path));
+        }
+
+        std::cout << "running this motherfucker rn: " <<  path << std::endl;
+
+        std::tuple<std::unordered_map<std::filesystem::path, IndexedDirectory>,
+                   std::unordered_map<std::filesystem::path, IndexedFile>> result;
+        {
+            IndexingGuard guard(indexing);
+
+            // Writers wait for the whole crawl so no watcher batch is published
+            // on the side and then lost; readers keep using the current version,
+            // which also serves as the cache
+            std::lock_guard<std::mutex> lock(index_mutex);
+            const IndexSnapshot cache = Snapshot();
+
+            IndexStore store = IndexDirectory(path, *cache, indexing);
 
-        IndexDirectory(path, files, dirs, files_from_disk, dirs_from_disk);
+            // a cancelled crawl is missing whole subtrees; publishing it would
+            // let the next incremental pass carry those holes forward
+            if (!indexing)
+                return {};
 
-        // Update global index
-        file_index = std::move(files);
-        dir_index = std::move(dirs);
+            result = MaterializeSubtree(store, ROOT_ENTRY);
+            Publish(std::move(store));
+        }
 
-        return {dir_index, file_index};
+        // must run without index_mutex: restarting joins the watcher thread
+        WatchIndexedTree(path);
+        return result;
     }
 
     std::tuple<std::vector<IndexedDirectory>, std::vector<IndexedFile>> 
-    ShowFilesAndDirsInTab(const std::string& path)
+    ShowFilesAndDirsInTab(const std::filesystem::path& path)
     {
         std::vector<IndexedDirectory> dirs;
         std::vector<IndexedFile> files;
         
-        std::lock_guard<std::mutex> lock(index_mutex);
+        const IndexSnapshot index = Snapshot();
         
-        for (const auto& [p, d] : dir_index) {
-            if (p.parent_path() == path) {
-                dirs.push_back(d);
-            }
-        }
-        
-        for (const auto& [p, f] : file_index) {
-            if (p.parent_path() == path) {
-                files.push_back(f);
-            }
+        EntryId parent = index->Find(path);
+        if (parent == INVALID_ENTRY)
+            return {dirs, files};
+
+        for (EntryId id = index->FirstChild(parent); id != INVALID_ENTRY; id = index->NextSibling(id)) {
+            if (index->IsDirectory(id))
+                dirs.push_back(index->MaterializeDirectory(id));
+            else
+                files.push_back(index->MaterializeFile(id));
         }
         
         return {dirs, files};
@@ -560,32 +1100,177 @@ namespace fileindexer
     std::vector<IndexedFile> ShowFilesInTab(const std::string& path)
     {
         std::vector<IndexedFile> files;
-        std::lock_guard<std::mutex> lock(index_mutex);
+        const IndexSnapshot index = Snapshot();
         
-        for (const auto& [p, f] : file_index) {
-            if (p.parent_path() == path) {
-                files.push_back(f);
+        EntryId parent = index->Find(path);
+        if (parent == INVALID_ENTRY)
+            return files;
+
+        for (EntryId id = index->FirstChild(parent); id != INVALID_ENTRY; id = index->NextSibling(id)) {
+            if (!index->IsDirectory(id)) {
+                files.push_back(index->MaterializeFile(id));
             }
         }
         
         return files;
     }
 
-    const std::unordered_map<std::filesystem::path, IndexedFile>& GetFileIndex()
+    std::vector<IndexedFile> LargestFiles(const std::filesystem::path &path, std::size_t n)
+    {
+        std::vector<IndexedFile> files;
+        const IndexSnapshot index = Snapshot();
+
+        EntryId top = index->Find(path);
+        if (top == INVALID_ENTRY)
+            return files;
+
+        for (EntryId id : index->Largest(n, false, top))
+            files.push_back(index->MaterializeFile(id));
+        return files;
+    }
+
+    std::vector<IndexedFile> RecentFiles(const std::filesystem::path &path, std::chrono::seconds age, std::size_t limit)
+    {
+        std::vector<IndexedFile> files;
+        const IndexSnapshot index = Snapshot();
+
+        EntryId top = index->Find(path);
+        if (top == INVALID_ENTRY)
+            return files;
+
+        const auto since = std::filesystem::file_time_type::clock::now() - age;
+        for (EntryId id : index->ModifiedSince(ToNanoseconds(since), limit, false, top))
+            files.push_back(index->MaterializeFile(id));
+        return files;
+    }
+
+    void StartContentSearch(const std::filesystem::path &path, const std::string &text, bool match_case, std::size_t max_hits)
+    {
+        const IndexSnapshot index = Snapshot();
+        std::vector<EntryId> files;
+
+        EntryId top = index->Find(path);
+        if (top != INVALID_ENTRY)
+        {
+            // by inode, roughly the order the files lie on disk, to keep seeks short
+            std::vector<std::pair<std::uint64_t, EntryId>> by_inode;
+            for (std::uint32_t id : index->TypeBitmap(TEXT).ToVector())
+            {
+                if (top == ROOT_ENTRY || index->IsWithin(id, top))
+                    by_inode.emplace_back(index->Metadata(id).inode, id);
+            }
+            std::sort(by_inode.begin(), by_inode.end());
+            files.reserve(by_inode.size());
+            for (const auto &entry : by_inode)
+                files.push_back(entry.second);
+        }
+        content_search.Start(index, std::move(files), text, match_case, max_hits);
+    }
+
+    std::vector<ContentHit> TakeContentHits()
+    {
+        return content_search.TakeHits();
+    }
+
+    void CancelContentSearch()
+    {
+        content_search.Cancel();
+    }
+
+    bool IsContentSearching()
+    {
+        return content_search.Running();
+    }
+
+    void UpdateContentIndex(const std::string &path)
+    {
+        // raised here rather than in the thread, so a second call right
+        // after this one sees it and returns
+        bool idle = false;
+        if (!content_indexing.compare_exchange_strong(idle, true))
+            return;
+        if (content_index_thread.joinable())
+            content_index_thread.join();
+
+        content_index_thread = std::thread([path]()
+        {
+            // a Shutdown before this point has lowered the flag already,
+            // and Refresh then stops at once
+            IndexingGuard guard(content_indexing, false);
+            MEASURE_TIME("UpdateContentIndex");
+
+            const std::filesystem::path file = std::filesystem::path(path) / ".index.content";
+            ContentIndex next = *std::atomic_load(&content_index);
+            if (next.DocumentCount() == 0)
+                next.Load(file);
+
+            // saved only when complete; a cancelled pass is still published
+            if (next.Refresh(*Snapshot(), content_indexing))
+                next.Save(file);
+            std::atomic_store(&content_index, std::shared_ptr<const ContentIndex>(std::make_shared<const ContentIndex>(std::move(next))));
+        });
+    }
+
+    bool IsContentIndexing()
+    {
+        return content_indexing;
+    }
+
+    std::vector<IndexedFile> SearchContentIndex(const std::string &words, std::size_t limit)
+    {
+        std::vector<IndexedFile> files;
+        const IndexSnapshot index = Snapshot();
+        const std::shared_ptr<const ContentIndex> contents = std::atomic_load(&content_index);
+
+        for (const ContentIndex::Document &doc : contents->Lookup(words))
+        {
+            EntryId id = index->Find(doc.path);
+            if (id == INVALID_ENTRY || index->Size(id) != doc.size || index->ModifiedNs(id) != doc.mtime)
+                continue;
+            files.push_back(index->MaterializeFile(id));
+            if (limit != 0 && files.size() == limit)
+                break;
+        }
+        return files;
+    }
+
+    std::vector<std::vector<IndexedFile>> FindDuplicates(const std::filesystem::path &path)
     {
-        return file_index;
+        MEASURE_TIME("FindDuplicates");
+        std::vector<std::vector<IndexedFile>> duplicates;
+        const IndexSnapshot index = Snapshot();
+
+        EntryId top = index->Find(path);
+        if (top == INVALID_ENTRY)
+            return duplicates;
+
+        for (const DuplicateGroup &group : duplicate_finder.Find(*index, top, keep_finding))
+        {
+            std::vector<IndexedFile> files;
+            files.reserve(group.files.size());
+            for (EntryId id : group.files)
+                files.push_back(index->MaterializeFile(id));
+            duplicates.push_back(std::move(files));
+        }
+        return duplicates;
     }
 
-    const std::unordered_map<std::filesystem::path, IndexedDirectory>& GetDirectoryIndex()
+    IndexSnapshot GetIndex()
     {
-        return dir_index;
+        return Snapshot();
     }
 
     void Shutdown()
     {
         indexing = false;
+        content_indexing = false;
+        keep_finding = false;
+        content_search.Cancel();
+        index_watcher.Stop();
         if (index_thread.joinable())
             index_thread.join();
+        if (content_index_thread.joinable())
+            content_index_thread.join();
     }
 
     void StartIndexing(const std::string &directory)
@@ -595,42 +1280,26 @@ namespace fileindexer
         if (index_thread.joinable())
             index_thread.join();
 
-        {
-            std::lock_guard<std::mutex> lock(index_mutex);
-            file_index.clear();
-            dir_index.clear();
-        }
-
         index_thread = std::thread([directory]()
         {
             IndexingGuard guard(indexing);
-            
-            std::unordered_map<std::filesystem::path, IndexedFile> files_from_disk;
-            std::unordered_map<std::filesystem::path, IndexedDirectory> dirs_from_disk;
-            
-            // Try to load existing index
-            {
-                std::lock_guard<std::mutex> lock(index_mutex);
-                for (const auto& [p, f] : file_index) {
-                    files_from_disk[p] = f;
-                }
-                for (const auto& [p, d] : dir_index) {
-                    dirs_from_disk[p] = d;
-                }
-            }
-            
-            std::unordered_map<std::filesystem::path, IndexedFile> files;
-            std::unordered_map<std::filesystem::path, IndexedDirectory> dirs;
-
-            IndexDirectory(directory, files, dirs, files_from_disk, dirs_from_disk);
 
             {
+                // Held across the crawl, as in ShowFilesAndDirsContinuous: a
+                // watcher batch applied in the meantime would be overwritten
+                // by this store. Readers keep the current version, which
+                // (e.g. a loaded index) is also the cache.
                 std::lock_guard<std::mutex> lock(index_mutex);
-                file_index = std::move(files);
-                dir_index = std::move(dirs);
+                const IndexSnapshot cache = Snapshot();
+
+                IndexStore store = IndexDirectory(directory, *cache, indexing);
+                if (!indexing)
+                    return;
+                Publish(std::move(store));
             }
 
             SaveToFile(directory);
+            WatchIndexedTree(directory);
         });
     }
-}
\ No newline at end of file
+}
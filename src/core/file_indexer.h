@@ -6,15 +6,21 @@
 #include <mutex>
 #include <thread>
 #include <atomic>
+#include <chrono>
 #include <unordered_map>
 #include <tuple>
 #include "json.hpp"
+#include "crawl_backend.h"
+#include "index_store.h"
+#include "search_engine.h"
+#include "content_search.h"
+#include "search_results.h"
 
 using json = nlohmann::json;
 
 namespace fileindexer {
 
-    enum EXTENSION_TYPE
+    enum EXTENSION_TYPE : std::uint8_t
     {
         DIRECTORY,
         ARCHIVE,
@@ -36,6 +42,8 @@ namespace fileindexer {
         std::filesystem::file_time_type last_modified;
         EXTENSION_TYPE extension_type;
         std::string extension;
+        std::uint64_t inode;
+        std::int64_t change_time_ns;
     
         void to_json(json& j) const;
         void from_json(const json& j);
@@ -44,26 +52,84 @@ namespace fileindexer {
     struct IndexedDirectory {
         std::string name;
         std::filesystem::path path;
-        std::uintmax_t size;
+        std::uintmax_t size; // recursive
         std::filesystem::file_time_type last_modified;
+        std::uint64_t inode;
+        std::int64_t change_time_ns;
     
         void to_json(json& j) const;
         void from_json(const json& j);
     };
 
+    struct CrawlOptions {
+        // worker threads for the crawler, 0 = pick from hardware concurrency
+        unsigned threads = 0;
+        // how directories are listed; NATIVE falls back to PORTABLE off Linux
+        CrawlBackend backend = DefaultCrawlBackend();
+        // only re-list directories whose mtime changed and carry the cached
+        // children of the rest over; off = re-list every directory
+        bool incremental = true;
+    };
+
     void StartIndexing(const std::string& directory);
+    // false if there is no index at path or it was written in another
+    // format version; the caller crawls instead
     bool LoadFromFile(const std::string& path);
     void SaveToFile(const std::string& path);
     EXTENSION_TYPE GetExtensionType(std::filesystem::path extension);
     std::vector<IndexedFile> ShowFilesInTab(const std::string& path);
-    std::vector<IndexedFile> SearchFiles(const std::string& query);
-    std::vector<IndexedDirectory> SearchDirectories(const std::string& query);
-    std::tuple<std::vector<IndexedDirectory>, std::vector<IndexedFile>> ShowFilesAndDirsInTab(const std::filesystem::path path);
+    // Best matches first, at most limit of them (0 = all). The query may
+    // carry filters such as ext:pdf or size:>100MB, see SearchQuery. Runs on
+    // a thread pool; a call still running when the next one starts returns
+    // nothing.
+    std::vector<IndexedFile> SearchFiles(const std::string& query, std::size_t limit = DEFAULT_SEARCH_LIMIT,
+                                         MatchMode mode = MatchMode::SUBSTRING);
+    std::vector<IndexedDirectory> SearchDirectories(const std::string& query, std::size_t limit = DEFAULT_SEARCH_LIMIT,
+                                                    MatchMode mode = MatchMode::SUBSTRING);
+    // The same searches, returning handles into the index version searched
+    // instead of copies, limit 0 = every match. Nothing leaves the index
+    // until a row is read, so a view can page through half a million hits
+    // and materialize only the rows on screen.
+    SearchResults FindFiles(const std::string& query, std::size_t limit = 0, MatchMode mode = MatchMode::SUBSTRING);
+    SearchResults FindDirectories(const std::string& query, std::size_t limit = 0, MatchMode mode = MatchMode::SUBSTRING);
+    // the n largest files below path, largest first
+    std::vector<IndexedFile> LargestFiles(const std::filesystem::path& path, std::size_t n);
+    // files below path modified within the last age, newest first, at most
+    // limit of them (0 = all)
+    std::vector<IndexedFile> RecentFiles(const std::filesystem::path& path, std::chrono::seconds age,
+                                         std::size_t limit = DEFAULT_SEARCH_LIMIT);
+    // Starts looking for text inside the indexed text files below path, in
+    // the background, replacing any content search still running. Matching
+    // ignores ASCII case unless match_case is set.
+    void StartContentSearch(const std::filesystem::path& path, const std::string& text, bool match_case = false,
+                            std::size_t max_hits = DEFAULT_SEARCH_LIMIT);
+    // lines found since the last call
+    std::vector<ContentHit> TakeContentHits();
+    void CancelContentSearch();
+    bool IsContentSearching();
+    // Brings the word index over the indexed text files up to date in the
+    // background: loads the one saved next to path's index the first time,
+    // rereads only files whose size or mtime changed, and saves it back.
+    void UpdateContentIndex(const std::string& path);
+    bool IsContentIndexing();
+    // Text files containing every word of words, as the word index has
+    // them; no file is opened. Files changed since they were last read are
+    // left out until the next UpdateContentIndex.
+    std::vector<IndexedFile> SearchContentIndex(const std::string& words, std::size_t limit = DEFAULT_SEARCH_LIMIT);
+    // Sets of files with identical contents below path, the sets wasting the
+    // most space first. Only files sharing a size are opened, most of them
+    // only at both ends; hashes are remembered between calls, so a second
+    // run reads just the files that changed.
+    std::vector<std::vector<IndexedFile>> FindDuplicates(const std::filesystem::path& path);
+    std::tuple<std::vector<IndexedDirectory>, std::vector<IndexedFile>> ShowFilesAndDirsInTab(const std::filesystem::path& path);
     std::tuple<std::unordered_map<std::filesystem::path, IndexedDirectory>, std::unordered_map<std::filesystem::path, IndexedFile>> ShowFilesAndDirsContinuous(const std::filesystem::path& path);
     std::uintmax_t GetDirectorySize(const std::filesystem::path& dir);
     std::string HumanReadableSize(std::uintmax_t size);
     bool IsIndexing();
-    const std::unordered_map<std::filesystem::path, IndexedFile>& GetFileIndex();
-    const std::unordered_map<std::filesystem::path, IndexedDirectory>& GetDirectoryIndex();
+    void SetCrawlOptions(const CrawlOptions& options);
+    CrawlOptions GetCrawlOptions();
+    // the current version of the index; never blocks, and stays valid
+    // however the index changes afterwards
+    IndexSnapshot GetIndex();
     void Shutdown(); 
 }
\ No newline at end of file
@@ -0,0 +1,158 @@
+#include "fuzzy_match.h"
+#include <algorithm>
+
+namespace fileindexer
+{
+    namespace
+    {
+        // fzf's weights: a match is worth 16, and a word start is worth half
+        // a match so that "fi" prefers "file_indexer" to "profile"
+        constexpr int SCORE_MATCH = 16;
+        constexpr int SCORE_GAP_START = -3;
+        constexpr int SCORE_GAP_EXTENSION = -1;
+        constexpr int BONUS_BOUNDARY = SCORE_MATCH / 2;
+        constexpr int BONUS_BOUNDARY_WHITE = BONUS_BOUNDARY + 2;
+        constexpr int BONUS_BOUNDARY_DELIMITER = BONUS_BOUNDARY + 1;
+        constexpr int BONUS_NON_WORD = SCORE_MATCH / 2;
+        constexpr int BONUS_CAMEL123 = BONUS_BOUNDARY - 1;
+        constexpr int BONUS_CONSECUTIVE = -(SCORE_GAP_START + SCORE_GAP_EXTENSION);
+        // the first query character decides most of what the user meant
+        constexpr int BONUS_FIRST_CHAR_MULTIPLIER = 2;
+
+        enum class CharClass : std::uint8_t
+        {
+            WHITE,
+            DELIMITER,
+            NON_WORD,
+            LOWER,
+            UPPER,
+            NUMBER
+        };
+
+        CharClass ClassOf(char c)
+        {
+            if (c >= 'a' && c <= 'z')
+                return CharClass::LOWER;
+            if (c >= 'A' && c <= 'Z')
+                return CharClass::UPPER;
+            if (c >= '0' && c <= '9')
+                return CharClass::NUMBER;
+            if (c == ' ' || c == '\t')
+                return CharClass::WHITE;
+            if (c == '/' || c == '\\' || c == '_' || c == '-' || c == '.' || c == ',' || c == ':' || c == ';' || c == '|')
+                return CharClass::DELIMITER;
+            // bytes of multibyte UTF-8 characters count as letters
+            if (static_cast<unsigned char>(c) >= 0x80)
+                return CharClass::LOWER;
+            return CharClass::NON_WORD;
+        }
+
+        bool IsWord(CharClass c)
+        {
+            return c == CharClass::LOWER || c == CharClass::UPPER || c == CharClass::NUMBER;
+        }
+
+        int BonusFor(CharClass prev, CharClass cur)
+        {
+            if (IsWord(cur))
+            {
+                if (prev == CharClass::WHITE)
+                    return BONUS_BOUNDARY_WHITE;
+                if (prev == CharClass::DELIMITER)
+                    return BONUS_BOUNDARY_DELIMITER;
+                if (prev == CharClass::NON_WORD)
+                    return BONUS_BOUNDARY;
+            }
+            if ((prev == CharClass::LOWER && cur == CharClass::UPPER) ||
+                (prev != CharClass::NUMBER && cur == CharClass::NUMBER))
+                return BONUS_CAMEL123;
+            if (!IsWord(cur))
+                return BONUS_NON_WORD;
+            return 0;
+        }
+    }
+
+    std::uint32_t CharMask(std::string_view lower)
+    {
+        std::uint32_t mask = 0;
+        for (char ch : lower)
+        {
+            auto c = static_cast<unsigned char>(ch);
+            unsigned bit;
+            if (c >= 'a' && c <= 'z')
+                bit = c - 'a';
+            else if (c >= '0' && c <= '9')
+                bit = 26 + (c - '0') / 2;
+            else
+                bit = 31;
+            mask |= std::uint32_t{1} << bit;
+        }
+        return mask;
+    }
+
+    bool FuzzyScore(std::string_view name, std::string_view lower_name, std::string_view lower_query, int &score)
+    {
+        score = 0;
+        if (lower_query.empty())
+            return true;
+        if (lower_query.size() > lower_name.size())
+            return false;
+
+        // the first place every query character has been seen, in order
+        std::size_t end = 0;
+        std::size_t q = 0;
+        for (; end < lower_name.size(); ++end)
+        {
+            if (lower_name[end] == lower_query[q] && ++q == lower_query.size())
+                break;
+        }
+        if (q < lower_query.size())
+            return false;
+
+        // then back from there to the latest start, which drops the stray
+        // early matches "a" would otherwise pick up in "a_b_c_abc"
+        std::size_t start = end;
+        for (q = lower_query.size(); start != std::string_view::npos; --start)
+        {
+            if (lower_name[start] == lower_query[q - 1] && --q == 0)
+                break;
+        }
+
+        CharClass prev = start == 0 ? CharClass::DELIMITER : ClassOf(name[start - 1]);
+        int first_bonus = 0;
+        int consecutive = 0;
+        bool in_gap = false;
+        q = 0;
+        for (std::size_t i = start; i <= end; ++i)
+        {
+            const CharClass cls = ClassOf(name[i]);
+            if (q < lower_query.size() && lower_name[i] == lower_query[q])
+            {
+                score += SCORE_MATCH;
+                int bonus = BonusFor(prev, cls);
+                if (consecutive == 0)
+                    first_bonus = bonus;
+                else
+                {
+                    // a run keeps the bonus of the boundary it started on
+                    if (bonus >= BONUS_BOUNDARY && bonus > first_bonus)
+                        first_bonus = bonus;
+                    bonus = std::max({bonus, first_bonus, BONUS_CONSECUTIVE});
+                }
+                score += q == 0 ? bonus * BONUS_FIRST_CHAR_MULTIPLIER : bonus;
+                ++consecutive;
+                in_gap = false;
+                ++q;
+            }
+            else
+            {
+                score += in_gap ? SCORE_GAP_EXTENSION : SCORE_GAP_START;
+                consecutive = 0;
+                first_bonus = 0;
+                in_gap = true;
+            }
+            prev = cls;
+        }
+        return true;
+    }
+}
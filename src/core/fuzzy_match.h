@@ -0,0 +1,28 @@
+#pragma once
+
+#include <cstdint>
+#include <string_view>
+
+namespace fileindexer {
+
+    // One bit per letter of a lowercase name, one per pair of digits, and
+    // one for everything else. A name can only contain a query as a
+    // subsequence if it has every bit the query has, so most names are
+    // turned down with one AND before their characters are looked at.
+    std::uint32_t CharMask(std::string_view lower);
+
+    inline bool MaskCovers(std::uint32_t name_mask, std::uint32_t query_mask)
+    {
+        return (query_mask & ~name_mask) == 0;
+    }
+
+    // Scores name against lower_query the way fzf does: every query character
+    // has to appear in order, each match earns points, gaps cost some, and
+    // matches at the start of a word (after a separator such as '/', '_',
+    // '-', '.' or a space, on a camelCase hump or where digits begin) and
+    // runs of consecutive matches earn bonuses. The shortest window ending at
+    // the first complete match is scored, which is what fzf does for large
+    // inputs. lower_name has to be the ASCII-lowercased name; name keeps the
+    // case for the camelCase bonus. False if lower_query is no subsequence.
+    bool FuzzyScore(std::string_view name, std::string_view lower_name, std::string_view lower_query, int& score);
+}
@@ -0,0 +1,729 @@
+#include "index_store.h"
+#include "file_indexer.h"
+#include "fuzzy_match.h"
+#include "name_scan.h"
+#include <algorithm>
+#include <cstring>
+#include <iterator>
+#include <limits>
+#include "common/xxhash.h"
+
+namespace fileindexer
+{
+    namespace
+    {
+        // same rules as std::filesystem::path::extension, without the path
+        std::string_view ExtensionOf(std::string_view name)
+        {
+            if (name == "." || name == "..")
+                return {};
+            auto dot = name.rfind('.');
+            if (dot == std::string_view::npos || dot == 0)
+                return {};
+            return name.substr(dot);
+        }
+    }
+
+    std::uint64_t HashName(std::string_view name)
+    {
+        return XXH64(name.data(), name.size(), 0);
+    }
+
+    std::uint32_t StringArena::Append(std::string_view s)
+    {
+        constexpr std::uint32_t block_size = 1u << BLOCK_BITS;
+        if (blocks_.empty() || filled_.back() + s.size() > block_size)
+        {
+            blocks_.emplace_back(new char[block_size]);
+            filled_.push_back(0);
+        }
+
+        std::uint32_t &used = filled_.back();
+        auto offset = static_cast<std::uint32_t>(((blocks_.size() - 1) << BLOCK_BITS) | used);
+        std::memcpy(blocks_.back().get() + used, s.data(), s.size());
+        used += static_cast<std::uint32_t>(s.size());
+        return offset;
+    }
+
+    void IndexStore::Reset(const std::filesystem::path &root, const EntryMetadata &root_meta)
+    {
+        *this = IndexStore();
+        root_path_ = root;
+
+        extensions_->names.emplace_back();
+        extensions_->types.push_back(EXTENSION_TYPE::FILE);
+        extensions_->ids.emplace("", 0);
+
+        // the root keeps its whole path as its name and has no parent
+        const std::string &native = root_path_.native();
+        parent_.push_back(INVALID_ENTRY);
+        first_child_.push_back(INVALID_ENTRY);
+        next_sibling_.push_back(INVALID_ENTRY);
+        name_offset_.push_back(AppendName(ROOT_ENTRY, native));
+        name_length_.push_back(static_cast<std::uint16_t>(native.size()));
+        name_hash_.push_back(FoldTo32(HashName(native)));
+        name_mask_.push_back(CharMask(LowerName(ROOT_ENTRY)));
+        extension_.push_back(0);
+        type_.push_back(EXTENSION_TYPE::DIRECTORY);
+        size_.push_back(root_meta.size);
+        mtime_.push_back(root_meta.mtime);
+        ctime_.push_back(root_meta.ctime_ns);
+        inode_.push_back(root_meta.inode);
+    }
+
+    void IndexStore::Reserve(std::size_t entries)
+    {
+        parent_.reserve(entries);
+        first_child_.reserve(entries);
+        next_sibling_.reserve(entries);
+        name_offset_.reserve(entries);
+        name_length_.reserve(entries);
+        name_hash_.reserve(entries);
+        name_mask_.reserve(entries);
+        extension_.reserve(entries);
+        type_.reserve(entries);
+        size_.reserve(entries);
+        mtime_.reserve(entries);
+        ctime_.reserve(entries);
+        inode_.reserve(entries);
+        while (entries * 4 > child_slots_.size() * 3)
+            GrowChildren();
+    }
+
+    std::uint32_t IndexStore::AppendName(EntryId id, std::string_view name)
+    {
+        std::uint32_t offset = names_.Append(name);
+        const std::string lower = ToLowerAscii(name);
+        lower_names_.Append(lower);
+        if (id != ROOT_ENTRY)
+            trigrams_.Add(id, lower);
+        return offset;
+    }
+
+    std::uint16_t IndexStore::InternExtension(std::string_view name)
+    {
+        std::string_view ext = ExtensionOf(name);
+        if (ext.empty())
+            return 0;
+
+        std::string key(ext);
+        auto it = extensions_->ids.find(key);
+        if (it != extensions_->ids.end())
+            return it->second;
+
+        if (extensions_->names.size() > 0xFFFF)
+            return 0; // table full; the entry just loses its extension
+
+        if (extensions_.use_count() > 1)
+            extensions_ = std::make_shared<Extensions>(*extensions_); // still part of a published snapshot
+        auto id = static_cast<std::uint16_t>(extensions_->names.size());
+        extensions_->types.push_back(GetExtensionType(std::filesystem::path(name)));
+        extensions_->names.push_back(key);
+        extensions_->ids.emplace(std::move(key), id);
+        return id;
+    }
+
+    EntryId IndexStore::Add(EntryId parent, std::string_view name, bool is_directory, const EntryMetadata &meta)
+    {
+        return Add(parent, name, HashName(name), is_directory, meta);
+    }
+
+    EntryId IndexStore::Add(EntryId parent, std::string_view name, std::uint64_t name_hash, bool is_directory, const EntryMetadata &meta)
+    {
+        auto id = static_cast<EntryId>(parent_.size());
+        std::uint16_t ext = is_directory ? 0 : InternExtension(name);
+
+        parent_.push_back(parent);
+        first_child_.push_back(INVALID_ENTRY);
+        next_sibling_.push_back(first_child_[parent]);
+        first_child_.Set(parent, id);
+        name_offset_.push_back(AppendName(id, name));
+        name_length_.push_back(static_cast<std::uint16_t>(name.size()));
+        name_hash_.push_back(FoldTo32(name_hash));
+        name_mask_.push_back(CharMask(LowerName(id)));
+        extension_.push_back(ext);
+        type_.push_back(is_directory ? static_cast<std::uint8_t>(EXTENSION_TYPE::DIRECTORY) : extensions_->types[ext]);
+        size_.push_back(is_directory ? 0 : meta.size); // directories are summed later
+        mtime_.push_back(meta.mtime);
+        ctime_.push_back(meta.ctime_ns);
+        inode_.push_back(meta.inode);
+
+        InsertChild(id);
+        Classify(id);
+        Order(id);
+
+        if (is_directory)
+            ++live_dirs_;
+        else
+            ++live_files_;
+        return id;
+    }
+
+    void IndexStore::Remove(EntryId id)
+    {
+        if (id == ROOT_ENTRY || !IsLive(id))
+            return;
+
+        Unlink(id);
+        MarkDead(id);
+    }
+
+    void IndexStore::Unlink(EntryId id)
+    {
+        // reads first, so only the chunk holding the link is cloned
+        const EntryId parent = parent_[id];
+        if (first_child_[parent] == id)
+        {
+            first_child_.Set(parent, next_sibling_[id]);
+        }
+        else
+        {
+            EntryId at = first_child_[parent];
+            while (at != INVALID_ENTRY && next_sibling_[at] != id)
+                at = next_sibling_[at];
+            if (at != INVALID_ENTRY)
+                next_sibling_.Set(at, next_sibling_[id]);
+        }
+        next_sibling_.Set(id, INVALID_ENTRY);
+    }
+
+    bool IndexStore::Move(EntryId id, EntryId new_parent, std::string_view new_name)
+    {
+        if (id == ROOT_ENTRY || !IsLive(id) || !IsLive(new_parent) || !IsDirectory(new_parent) || IsWithin(new_parent, id))
+            return false;
+
+        // rename(2) replaces whatever was at the destination
+        const std::uint64_t new_hash = HashName(new_name);
+        EntryId existing = FindChild(new_parent, new_name, new_hash);
+        if (existing == id)
+            return true;
+        if (existing != INVALID_ENTRY)
+            RemoveSubtree(existing);
+
+        Unlink(id);
+        EraseChild(id);
+
+        if (new_name != Name(id))
+        {
+            Rename(id, new_parent, new_name, FoldTo32(new_hash));
+            return true;
+        }
+
+        parent_.Set(id, new_parent);
+        next_sibling_.Set(id, first_child_[new_parent]);
+        first_child_.Set(new_parent, id);
+        InsertChild(id);
+        return true;
+    }
+
+    void IndexStore::Rename(EntryId id, EntryId new_parent, std::string_view new_name, std::uint32_t new_hash)
+    {
+        // appending under a new id keeps name offsets ascending by id
+        EntryId renamed = Add(new_parent, new_name, new_hash, IsDirectory(id), Metadata(id));
+        SetSize(renamed, size_[id]);
+
+        first_child_.Set(renamed, first_child_[id]);
+        first_child_.Set(id, INVALID_ENTRY);
+        for (EntryId child = first_child_[renamed]; child != INVALID_ENTRY; child = next_sibling_[child])
+        {
+            // lookup slots are placed by parent
+            EraseChild(child);
+            parent_.Set(child, renamed);
+            InsertChild(child);
+        }
+        MarkDead(id);
+    }
+
+    void IndexStore::Classify(EntryId id)
+    {
+        if (type_bitmaps_.size() <= type_[id])
+            type_bitmaps_.resize(type_[id] + 1u);
+        type_bitmaps_[type_[id]].Add(id);
+        if (IsDirectory(id))
+            return;
+        if (extension_bitmaps_.size() <= extension_[id])
+            extension_bitmaps_.resize(extension_[id] + 1u);
+        extension_bitmaps_[extension_[id]].Add(id);
+    }
+
+    void IndexStore::Unclassify(EntryId id)
+    {
+        type_bitmaps_[type_[id]].Remove(id);
+        if (!IsDirectory(id))
+            extension_bitmaps_[extension_[id]].Remove(id);
+    }
+
+    const RoaringBitmap &IndexStore::TypeBitmap(EXTENSION_TYPE type) const
+    {
+        static const RoaringBitmap none;
+        return type < type_bitmaps_.size() ? type_bitmaps_[type] : none;
+    }
+
+    const RoaringBitmap &IndexStore::ExtensionBitmap(std::uint16_t ext) const
+    {
+        static const RoaringBitmap none;
+        return ext < extension_bitmaps_.size() ? extension_bitmaps_[ext] : none;
+    }
+
+    void IndexStore::MarkDead(EntryId id)
+    {
+        EraseChild(id);
+        Unclassify(id);
+        Unorder(id);
+
+        if (IsDirectory(id))
+            --live_dirs_;
+        else
+            --live_files_;
+        type_.Set(id, DEAD);
+    }
+
+    void IndexStore::RemoveSubtree(EntryId id, bool keep_root)
+    {
+        // only the top has to leave a sibling list; the rest go with it
+        for (EntryId child : Subtree(id))
+            MarkDead(child);
+        first_child_.Set(id, INVALID_ENTRY);
+        if (!keep_root)
+            Remove(id);
+    }
+
+    void IndexStore::Graft(EntryId at, const IndexStore &subtree)
+    {
+        std::vector<EntryId> remap(subtree.Capacity(), INVALID_ENTRY);
+        remap[ROOT_ENTRY] = at;
+        for (EntryId id : subtree.Subtree(ROOT_ENTRY))
+        {
+            remap[id] = Add(remap[subtree.Parent(id)], subtree.Name(id), subtree.NameHash(id), subtree.IsDirectory(id), subtree.Metadata(id));
+            SetSize(remap[id], subtree.Size(id));
+        }
+    }
+
+    IndexStore IndexStore::Compacted() const
+    {
+        IndexStore out;
+        if (Empty())
+            return out;
+        out.Reset(root_path_, Metadata(ROOT_ENTRY));
+        out.Reserve(1 + live_files_ + live_dirs_);
+        out.Graft(ROOT_ENTRY, *this);
+        return out;
+    }
+
+    bool IndexStore::IsDirectory(EntryId id) const
+    {
+        return type_[id] == EXTENSION_TYPE::DIRECTORY;
+    }
+
+    std::filesystem::file_time_type IndexStore::ModifiedTime(EntryId id) const
+    {
+        return std::filesystem::file_time_type(
+            std::chrono::duration_cast<std::filesystem::file_time_type::duration>(std::chrono::nanoseconds(mtime_[id])));
+    }
+
+    EntryMetadata IndexStore::Metadata(EntryId id) const
+    {
+        return {size_[id], mtime_[id], ctime_[id], inode_[id]};
+    }
+
+    void IndexStore::SetMetadata(EntryId id, const EntryMetadata &meta)
+    {
+        Unorder(id);
+        if (!IsDirectory(id))
+            size_.Set(id, meta.size);
+        mtime_.Set(id, meta.mtime);
+        ctime_.Set(id, meta.ctime_ns);
+        inode_.Set(id, meta.inode);
+        Order(id);
+    }
+
+    void IndexStore::SetSize(EntryId id, std::uint64_t size)
+    {
+        if (ordered_ && id != ROOT_ENTRY && IsLive(id))
+        {
+            size_order_[IsDirectory(id)].Erase(size_[id], id);
+            size_order_[IsDirectory(id)].Insert(size, id);
+        }
+        size_.Set(id, size);
+    }
+
+    void IndexStore::Order(EntryId id)
+    {
+        if (!ordered_ || id == ROOT_ENTRY || !IsLive(id))
+            return;
+        size_order_[IsDirectory(id)].Insert(size_[id], id);
+        mtime_order_[IsDirectory(id)].Insert(MtimeKey(mtime_[id]), id);
+    }
+
+    void IndexStore::Unorder(EntryId id)
+    {
+        if (!ordered_ || id == ROOT_ENTRY || !IsLive(id))
+            return;
+        size_order_[IsDirectory(id)].Erase(size_[id], id);
+        mtime_order_[IsDirectory(id)].Erase(MtimeKey(mtime_[id]), id);
+    }
+
+    void IndexStore::BuildOrders()
+    {
+        std::vector<OrderedIndex::Item> by_size[2];
+        std::vector<OrderedIndex::Item> by_mtime[2];
+        for (bool directories : {false, true})
+        {
+            by_size[directories].reserve(directories ? live_dirs_ : live_files_);
+            by_mtime[directories].reserve(directories ? live_dirs_ : live_files_);
+        }
+        for (EntryId id = ROOT_ENTRY + 1; id < Capacity(); ++id)
+        {
+            if (!IsLive(id))
+                continue;
+            by_size[IsDirectory(id)].push_back({size_[id], id});
+            by_mtime[IsDirectory(id)].push_back({MtimeKey(mtime_[id]), id});
+        }
+        for (bool directories : {false, true})
+        {
+            size_order_[directories].Assign(std::move(by_size[directories]));
+            mtime_order_[directories].Assign(std::move(by_mtime[directories]));
+        }
+        ordered_ = true;
+    }
+
+    std::vector<EntryId> IndexStore::Largest(std::size_t n, bool directories, EntryId within) const
+    {
+        std::vector<EntryId> ids;
+        if (n == 0)
+            return ids;
+        size_order_[directories].VisitBetween(0, std::numeric_limits<std::uint64_t>::max(), true, [&](const OrderedIndex::Item &item)
+        {
+            if (within == ROOT_ENTRY || (item.id != within && IsWithin(item.id, within)))
+                ids.push_back(item.id);
+            return ids.size() < n;
+        });
+        return ids;
+    }
+
+    std::vector<EntryId> IndexStore::ModifiedSince(std::int64_t since, std::size_t n, bool directories, EntryId within) const
+    {
+        std::vector<EntryId> ids;
+        mtime_order_[directories].VisitBetween(MtimeKey(since), std::numeric_limits<std::uint64_t>::max(), true, [&](const OrderedIndex::Item &item)
+        {
+            if (within == ROOT_ENTRY || (item.id != within && IsWithin(item.id, within)))
+                ids.push_back(item.id);
+            return n == 0 || ids.size() < n;
+        });
+        return ids;
+    }
+
+    std::filesystem::path IndexStore::PathOf(EntryId id) const
+    {
+        EntryId chain[256];
+        std::size_t depth = 0;
+        std::size_t length = 0;
+        std::vector<EntryId> deep; // only for trees deeper than chain
+
+        for (EntryId at = id; at != INVALID_ENTRY; at = parent_[at])
+        {
+            if (depth < std::size(chain))
+                chain[depth] = at;
+            else
+                deep.push_back(at);
+            ++depth;
+            length += name_length_[at] + 1;
+        }
+
+        auto at_depth = [&](std::size_t i) { return i < std::size(chain) ? chain[i] : deep[i - std::size(chain)]; };
+
+        std::string out;
+        out.reserve(length);
+        for (std::size_t i = depth; i-- > 0;)
+        {
+            EntryId e = at_depth(i);
+            if (e != ROOT_ENTRY && !out.empty() && out.back() != std::filesystem::path::preferred_separator)
+                out.push_back(std::filesystem::path::preferred_separator);
+            out.append(Name(e));
+        }
+        return std::filesystem::path(std::move(out));
+    }
+
+    std::size_t IndexStore::ChildSlot(EntryId parent, std::uint32_t name_hash) const
+    {
+        std::uint64_t h = name_hash ^ (static_cast<std::uint64_t>(parent) * 0x9E3779B97F4A7C15ull);
+        return static_cast<std::size_t>(h ^ (h >> 29)) & (child_slots_.size() - 1);
+    }
+
+    void IndexStore::GrowChildren()
+    {
+        ChunkedColumn<EntryId> old = std::move(child_slots_);
+        child_slots_.assign(old.empty() ? 1024 : old.size() * 2, INVALID_ENTRY);
+        child_count_ = 0;
+        for (std::size_t i = 0; i < old.size(); ++i)
+        {
+            if (old[i] != INVALID_ENTRY)
+                InsertChild(old[i]);
+        }
+    }
+
+    // An existing live entry with the same parent and name is shadowed, so
+    // callers remove the old one first when replacing.
+    void IndexStore::InsertChild(EntryId id)
+    {
+        if ((child_count_ + 1) * 4 > child_slots_.size() * 3)
+            GrowChildren();
+
+        const std::size_t mask = child_slots_.size() - 1;
+        const std::uint32_t hash = name_hash_[id];
+        for (std::size_t i = ChildSlot(parent_[id], hash);; i = (i + 1) & mask)
+        {
+            EntryId at = child_slots_[i];
+            if (at == INVALID_ENTRY)
+            {
+                child_slots_.Set(i, id);
+                ++child_count_;
+                return;
+            }
+            if (parent_[at] == parent_[id] && name_hash_[at] == hash && Name(at) == Name(id))
+            {
+                child_slots_.Set(i, id);
+                return;
+            }
+        }
+    }
+
+    void IndexStore::EraseChild(EntryId id)
+    {
+        const std::size_t mask = child_slots_.size() - 1;
+        std::size_t i = ChildSlot(parent_[id], name_hash_[id]);
+        while (child_slots_[i] != id)
+        {
+            if (child_slots_[i] == INVALID_ENTRY)
+                return; // shadowed by a newer entry
+            i = (i + 1) & mask;
+        }
+
+        // backward-shift deletion keeps every probe chain intact without tombstones
+        for (std::size_t j = (i + 1) & mask; child_slots_[j] != INVALID_ENTRY; j = (j + 1) & mask)
+        {
+            std::size_t home = ChildSlot(parent_[child_slots_[j]], name_hash_[child_slots_[j]]);
+            bool movable = i <= j ? (home <= i || home > j) : (home <= i && home > j);
+            if (movable)
+            {
+                child_slots_.Set(i, child_slots_[j]);
+                i = j;
+            }
+        }
+        child_slots_.Set(i, INVALID_ENTRY);
+        --child_count_;
+    }
+
+    EntryId IndexStore::FindChild(EntryId parent, std::string_view name) const
+    {
+        return FindChild(parent, name, HashName(name));
+    }
+
+    EntryId IndexStore::FindChild(EntryId parent, std::string_view name, std::uint64_t name_hash) const
+    {
+        if (child_slots_.empty())
+            return INVALID_ENTRY;
+
+        const std::uint32_t hash = FoldTo32(name_hash);
+        const std::size_t mask = child_slots_.size() - 1;
+        for (std::size_t i = ChildSlot(parent, hash);; i = (i + 1) & mask)
+        {
+            EntryId at = child_slots_[i];
+            if (at == INVALID_ENTRY)
+                return INVALID_ENTRY;
+            if (parent_[at] == parent && name_hash_[at] == hash && Name(at) == name)
+                return at;
+        }
+    }
+
+    EntryId IndexStore::Find(const std::filesystem::path &path) const
+    {
+        if (Empty())
+            return INVALID_ENTRY;
+
+        const std::string &p = path.native();
+        const std::string &root = root_path_.native();
+        if (p.compare(0, root.size(), root) != 0)
+            return INVALID_ENTRY;
+
+        std::size_t pos = root.size();
+        if (pos < p.size() && !root.empty() && root.back() != std::filesystem::path::preferred_separator)
+        {
+            if (p[pos] != std::filesystem::path::preferred_separator)
+                return INVALID_ENTRY; // "/a/bc" is not below "/a/b"
+        }
+
+        EntryId at = ROOT_ENTRY;
+        while (at != INVALID_ENTRY && pos < p.size())
+        {
+            while (pos < p.size() && p[pos] == std::filesystem::path::preferred_separator)
+                ++pos;
+            std::size_t end = p.find(std::filesystem::path::preferred_separator, pos);
+            if (end == std::string::npos)
+                end = p.size();
+            if (end > pos)
+                at = FindChild(at, std::string_view(p).substr(pos, end - pos));
+            pos = end;
+        }
+        return at;
+    }
+
+    bool IndexStore::IsWithin(EntryId id, EntryId ancestor) const
+    {
+        for (EntryId at = id; at != INVALID_ENTRY; at = parent_[at])
+        {
+            if (at == ancestor)
+                return true;
+        }
+        return false;
+    }
+
+    std::vector<EntryId> IndexStore::Subtree(EntryId top) const
+    {
+        std::vector<EntryId> ids;
+        if (top == INVALID_ENTRY || !IsLive(top))
+            return ids;
+
+        // preorder over the child lists: every entry is emitted before anything
+        // below it, and nothing outside the subtree is touched
+        std::vector<EntryId> stack{top};
+        while (!stack.empty())
+        {
+            EntryId at = stack.back();
+            stack.pop_back();
+            for (EntryId child = first_child_[at]; child != INVALID_ENTRY; child = next_sibling_[child])
+            {
+                ids.push_back(child);
+                if (first_child_[child] != INVALID_ENTRY)
+                    stack.push_back(child);
+            }
+        }
+        return ids;
+    }
+
+    EntryId IndexStore::FirstNameAt(std::uint32_t offset, EntryId from) const
+    {
+        EntryId low = from;
+        EntryId high = Capacity();
+        while (low < high)
+        {
+            const EntryId mid = low + (high - low) / 2;
+            if (name_offset_[mid] < offset)
+                low = mid + 1;
+            else
+                high = mid;
+        }
+        return low;
+    }
+
+    std::vector<EntryId> IndexStore::ScanNames(std::string_view lower_query) const
+    {
+        return ScanNames(lower_query, 0, lower_names_.BlockCount());
+    }
+
+    std::vector<EntryId> IndexStore::ScanNames(std::string_view lower_query, std::size_t first_block, std::size_t end_block) const
+    {
+        std::vector<EntryId> ids;
+        end_block = std::min(end_block, lower_names_.BlockCount());
+        if (first_block >= end_block)
+            return ids;
+
+        // the first entry whose name starts in first_block
+        EntryId entry = FirstNameAt(StringArena::BlockOffset(first_block), ROOT_ENTRY);
+
+        for (std::size_t b = first_block; b < end_block; ++b)
+        {
+            const std::string_view block = lower_names_.Block(b);
+            const std::uint32_t base = StringArena::BlockOffset(b);
+
+            for (std::size_t pos = FindLowered(block, lower_query); pos != std::string_view::npos;)
+            {
+                // the name this hit starts in: the last one appended at or before it
+                const auto at = static_cast<std::uint32_t>(base + pos);
+                entry = FirstNameAt(at + 1, entry) - 1;
+                const EntryId id = entry;
+                const std::size_t name_end = name_offset_[id] - base + name_length_[id];
+
+                // hits running into the next name are false; names of
+                // renamed and removed entries are skipped
+                if (pos + lower_query.size() <= name_end && id != ROOT_ENTRY && IsLive(id))
+                {
+                    ids.push_back(id);
+                    pos = name_end; // one hit per name is enough
+                }
+                else
+                {
+                    ++pos;
+                }
+                pos = FindLowered(block, lower_query, pos);
+            }
+        }
+
+        return ids;
+    }
+
+    void IndexStore::AccumulateSizes()
+    {
+        if (Empty())
+            return;
+
+        std::vector<EntryId> order = Subtree(ROOT_ENTRY);
+        size_.Set(ROOT_ENTRY, 0);
+        for (EntryId id : order)
+        {
+            if (IsDirectory(id))
+                size_.Set(id, 0);
+        }
+        // reversed preorder reaches every entry before its parent
+        for (auto it = order.rbegin(); it != order.rend(); ++it)
+            size_.Writable(parent_[*it]) += size_[*it];
+
+        // every directory may have moved; sorting again beats rekeying each
+        if (ordered_)
+            BuildOrders();
+    }
+
+    IndexedFile IndexStore::MaterializeFile(EntryId id) const
+    {
+        IndexedFile file;
+        file.name = std::string(Name(id));
+        file.path = PathOf(id);
+        file.size = size_[id];
+        file.last_modified = ModifiedTime(id);
+        file.extension_type = Type(id);
+        file.extension = std::string(Extension(id));
+        file.inode = inode_[id];
+        file.change_time_ns = ctime_[id];
+        return file;
+    }
+
+    IndexedDirectory IndexStore::MaterializeDirectory(EntryId id) const
+    {
+        IndexedDirectory dir;
+        dir.name = std::string(Name(id));
+        dir.path = PathOf(id);
+        dir.size = size_[id];
+        dir.last_modified = ModifiedTime(id);
+        dir.inode = inode_[id];
+        dir.change_time_ns = ctime_[id];
+        return dir;
+    }
+
+    std::size_t IndexStore::MemoryUsage() const
+    {
+        std::size_t columns = parent_.MemoryUsage() + first_child_.MemoryUsage() + next_sibling_.MemoryUsage() +
+                              name_offset_.MemoryUsage() + name_length_.MemoryUsage() + name_hash_.MemoryUsage() +
+                              name_mask_.MemoryUsage() + extension_.MemoryUsage() + type_.MemoryUsage() + size_.MemoryUsage() +
+                              mtime_.MemoryUsage() + ctime_.MemoryUsage() + inode_.MemoryUsage();
+        std::size_t bitmaps = 0;
+        for (const auto *set : {&type_bitmaps_, &extension_bitmaps_})
+        {
+            for (const RoaringBitmap &bitmap : *set)
+                bitmaps += sizeof(RoaringBitmap) + bitmap.MemoryUsage();
+        }
+        return columns + names_.Bytes() + lower_names_.Bytes() +
+               child_slots_.MemoryUsage() + trigrams_.MemoryUsage() + bitmaps +
+               size_order_[0].MemoryUsage() + size_order_[1].MemoryUsage() +
+               mtime_order_[0].MemoryUsage() + mtime_order_[1].MemoryUsage();
+    }
+}
@@ -0,0 +1,303 @@
+#pragma once
+
+#include <cstdint>
+#include <filesystem>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+#include "chunked_column.h"
+#include "ordered_index.h"
+#include "roaring_bitmap.h"
+#include "trigram_index.h"
+
+namespace fileindexer {
+
+    enum EXTENSION_TYPE : std::uint8_t;
+    struct IndexedFile;
+    struct IndexedDirectory;
+
+    constexpr EntryId INVALID_ENTRY = 0xFFFFFFFFu;
+    constexpr EntryId ROOT_ENTRY = 0;
+
+    // XXH64 of one path component. Computed once when a name enters the
+    // index and kept with the entry, so probing never rehashes the string.
+    std::uint64_t HashName(std::string_view name);
+
+    // Hashes the native string in one pass; std::hash<path> walks components.
+    struct PathHash {
+        std::size_t operator()(const std::filesystem::path& p) const
+        {
+            return static_cast<std::size_t>(HashName(p.native()));
+        }
+    };
+
+    struct EntryMetadata {
+        std::uint64_t size = 0;
+        std::int64_t mtime = 0;     // file clock ticks in nanoseconds
+        std::int64_t ctime_ns = 0;
+        std::uint64_t inode = 0;
+    };
+
+    // 32 bits of v; values that already fit come back unchanged. Only for
+    // what is confirmed some other way, such as name hashes.
+    inline std::uint32_t FoldTo32(std::uint64_t v)
+    {
+        return static_cast<std::uint32_t>(v ^ (v >> 32));
+    }
+
+    // Append-only storage for names. Blocks never move once allocated, so
+    // views into it stay valid for the arena's lifetime. A copy shares the
+    // blocks with its source, which is safe as long as only one of the two
+    // keeps appending; index snapshots are frozen once published.
+    class StringArena
+    {
+    public:
+        std::uint32_t Append(std::string_view s);
+        std::string_view View(std::uint32_t offset, std::uint16_t length) const
+        {
+            return {blocks_[offset >> BLOCK_BITS].get() + (offset & BLOCK_MASK), length};
+        }
+        std::size_t Bytes() const { return blocks_.size() << BLOCK_BITS; }
+
+        // The filled part of each block, names back to back. A string never
+        // straddles two blocks; offset of byte i of block b is b << 20 | i.
+        std::size_t BlockCount() const { return blocks_.size(); }
+        std::string_view Block(std::size_t b) const { return {blocks_[b].get(), filled_[b]}; }
+        static std::uint32_t BlockOffset(std::size_t b) { return static_cast<std::uint32_t>(b << BLOCK_BITS); }
+
+    private:
+        static constexpr unsigned BLOCK_BITS = 20;
+        static constexpr std::uint32_t BLOCK_MASK = (1u << BLOCK_BITS) - 1;
+
+        std::vector<std::shared_ptr<char[]>> blocks_;
+        std::vector<std::uint32_t> filled_;
+    };
+
+    // Columnar index of one tree, shaped as a path trie. Entry 0 is the root
+    // directory, whose name is the full root path, so the shared prefix is
+    // stored once; every other entry is a child of a directory entry and
+    // stores only its own name. Lookups walk components, full paths are
+    // rebuilt on demand, and subtrees are deleted, moved or listed by
+    // following links instead of scanning the index. Every name added is
+    // also posted to a trigram index for substring search, and a lowercase
+    // copy goes into a second arena that brute-force scans read straight
+    // through. Names are appended in id order, renames included, so name
+    // offsets ascend with ids and a hit in the arena maps back to its entry
+    // by binary search. Every live entry is also a member of the bitmap of
+    // its type and, for files, of its extension, and once BuildOrders has
+    // run it is kept sorted by size and by mtime as well.
+    //
+    // Everything a copy would duplicate is kept in shared pieces instead:
+    // column chunks, arena blocks, postings, bitmap containers, order
+    // blocks and the extension table. A copy of a million entries costs a
+    // few thousand pointers, and each change clones the pieces it touches,
+    // so the watcher can copy a snapshot for every batch.
+    //
+    // Per entry: parent 4, first child 4, next sibling 4, name offset 4, name
+    // length 2, name hash 4, name mask 4, extension id 2, type 1, size 8,
+    // mtime 8, ctime 8, inode 8 = 61 bytes, plus 5 to 11 bytes of lookup
+    // slots and the name twice. Trigram postings, bitmaps and orders come on top.
+    class IndexStore
+    {
+    public:
+        // drops everything and starts over with just the root entry
+        void Reset(const std::filesystem::path& root, const EntryMetadata& root_meta = {});
+        void Reserve(std::size_t entries);
+
+        bool Empty() const { return parent_.empty(); }
+        // number of ids handed out, including removed entries
+        EntryId Capacity() const { return static_cast<EntryId>(parent_.size()); }
+        std::size_t FileCount() const { return live_files_; }
+        std::size_t DirectoryCount() const { return live_dirs_; }
+        const std::filesystem::path& RootPath() const { return root_path_; }
+        // bumped every time a new version of the index is published
+        std::uint64_t Generation() const { return generation_; }
+        void SetGeneration(std::uint64_t generation) { generation_ = generation; }
+
+        EntryId Add(EntryId parent, std::string_view name, bool is_directory, const EntryMetadata& meta);
+        // same, for callers that already hold HashName(name)
+        EntryId Add(EntryId parent, std::string_view name, std::uint64_t name_hash, bool is_directory, const EntryMetadata& meta);
+        // marks one entry dead and unlinks it from its parent's children, which
+        // costs a walk over its siblings; children are left for the caller
+        void Remove(EntryId id);
+        // removes everything below id, and id itself unless keep_root is set
+        void RemoveSubtree(EntryId id, bool keep_root = false);
+        // Re-parents id under new_parent as new_name, replacing any entry
+        // already there. Everything below id follows without being touched,
+        // since descendants only store their own names. A new name moves the
+        // entry to a new id and only its children are relinked; id dies.
+        // Sizes are the caller's.
+        bool Move(EntryId id, EntryId new_parent, std::string_view new_name);
+        // copies every live entry of subtree below at; subtree's root maps onto at
+        void Graft(EntryId at, const IndexStore& subtree);
+        // a copy without removed entries; ids change
+        IndexStore Compacted() const;
+        std::size_t DeadCount() const { return parent_.size() - 1 - live_files_ - live_dirs_; }
+
+        bool IsLive(EntryId id) const { return type_[id] != DEAD; }
+        bool IsDirectory(EntryId id) const;
+        EntryId Parent(EntryId id) const { return parent_[id]; }
+        // A directory's live children form a singly linked list, newest first:
+        // for (EntryId c = FirstChild(d); c != INVALID_ENTRY; c = NextSibling(c))
+        EntryId FirstChild(EntryId id) const { return first_child_[id]; }
+        EntryId NextSibling(EntryId id) const { return next_sibling_[id]; }
+        std::string_view Name(EntryId id) const { return names_.View(name_offset_[id], name_length_[id]); }
+        // the 32 bits of HashName(Name(id)) that are kept; Add accepts either
+        std::uint64_t NameHash(EntryId id) const { return name_hash_[id]; }
+        std::string_view LowerName(EntryId id) const { return lower_names_.View(name_offset_[id], name_length_[id]); }
+        // CharMask of the lowercase name, for rejecting fuzzy queries early
+        std::uint32_t NameMask(EntryId id) const { return name_mask_[id]; }
+        EXTENSION_TYPE Type(EntryId id) const { return static_cast<EXTENSION_TYPE>(type_[id]); }
+        std::uint16_t ExtensionId(EntryId id) const { return extension_[id]; }
+        std::string_view Extension(EntryId id) const { return extensions_->names[extension_[id]]; }
+        // interned extensions, with their dot; id 0 is "no extension"
+        std::size_t ExtensionCount() const { return extensions_->names.size(); }
+        std::string_view ExtensionName(std::uint16_t ext) const { return extensions_->names[ext]; }
+        std::uint64_t Size(EntryId id) const { return size_[id]; }
+        // file clock ticks in nanoseconds, as in EntryMetadata
+        std::int64_t ModifiedNs(EntryId id) const { return mtime_[id]; }
+        std::filesystem::file_time_type ModifiedTime(EntryId id) const;
+        EntryMetadata Metadata(EntryId id) const;
+
+        void SetMetadata(EntryId id, const EntryMetadata& meta);
+        void SetSize(EntryId id, std::uint64_t size);
+        void AddSize(EntryId id, std::int64_t delta) { SetSize(id, size_[id] + static_cast<std::uint64_t>(delta)); }
+
+        std::filesystem::path PathOf(EntryId id) const;
+        EntryId FindChild(EntryId parent, std::string_view name) const;
+        EntryId FindChild(EntryId parent, std::string_view name, std::uint64_t name_hash) const;
+        // walks path component by component from the root
+        EntryId Find(const std::filesystem::path& path) const;
+        // id is ancestor itself or lies below it
+        bool IsWithin(EntryId id, EntryId ancestor) const;
+        // live entries below top, top excluded, parents before children;
+        // costs O(size of the subtree), not O(size of the index)
+        std::vector<EntryId> Subtree(EntryId top) const;
+
+        const TrigramIndex& Trigrams() const { return trigrams_; }
+        // live entries of one type, or files with one interned extension;
+        // the root is in neither
+        const RoaringBitmap& TypeBitmap(EXTENSION_TYPE type) const;
+        const RoaringBitmap& ExtensionBitmap(std::uint16_t ext) const;
+        // Live entries other than the root whose name contains lower_query,
+        // ascending. Runs the SIMD scan over the lowercase name arena instead
+        // of visiting entries one by one. The arena can be split up by block
+        // so that several threads scan it.
+        std::vector<EntryId> ScanNames(std::string_view lower_query) const;
+        std::vector<EntryId> ScanNames(std::string_view lower_query, std::size_t first_block, std::size_t end_block) const;
+        std::size_t NameBlockCount() const { return lower_names_.BlockCount(); }
+
+        // recomputes every directory's recursive size bottom-up
+        void AccumulateSizes();
+
+        // Sorts every live entry but the root by size and by mtime. Until
+        // then changes skip both orders, which keeps bulk loads cheap; from
+        // then on every change updates them, copies included. Publishing a
+        // store does this, so every snapshot has them.
+        void BuildOrders();
+        bool HasOrders() const { return ordered_; }
+        // files and directories are kept apart, since the recursive size of
+        // a directory would bury most files under its parents
+        const OrderedIndex& SizeOrder(bool directories) const { return size_order_[directories]; }
+        // keyed by MtimeKey
+        const OrderedIndex& MtimeOrder(bool directories) const { return mtime_order_[directories]; }
+        // mtimes as unsigned keys in the same order
+        static std::uint64_t MtimeKey(std::int64_t mtime) { return static_cast<std::uint64_t>(mtime) ^ (std::uint64_t{1} << 63); }
+
+        // Live files (or directories) below within, largest first, at most n.
+        // Walks the size order from the top and stops at the n-th hit, so
+        // the cost depends on how many larger entries of the same kind lie
+        // elsewhere rather than on the size of the index. Needs BuildOrders.
+        std::vector<EntryId> Largest(std::size_t n, bool directories, EntryId within = ROOT_ENTRY) const;
+        // Same, for entries modified at or after since, newest first; n 0 = all.
+        std::vector<EntryId> ModifiedSince(std::int64_t since, std::size_t n, bool directories, EntryId within = ROOT_ENTRY) const;
+
+        IndexedFile MaterializeFile(EntryId id) const;
+        IndexedDirectory MaterializeDirectory(EntryId id) const;
+
+        std::size_t MemoryUsage() const;
+
+    private:
+        static constexpr std::uint8_t DEAD = 0xFF;
+
+        std::uint16_t InternExtension(std::string_view name);
+        // stores name and its lowercase twin at the same offset
+        std::uint32_t AppendName(EntryId id, std::string_view name);
+        // the first entry at or after from whose name starts at offset or
+        // later; names ascend with ids
+        EntryId FirstNameAt(std::uint32_t offset, EntryId from) const;
+        // entry with a new name under new_parent, taking over id's children
+        void Rename(EntryId id, EntryId new_parent, std::string_view new_name, std::uint32_t new_hash);
+        // enter id into, or take it out of, the bitmaps of its current
+        // type and extension
+        void Classify(EntryId id);
+        void Unclassify(EntryId id);
+        // enter id into, or take it out of, the size and mtime orders
+        void Order(EntryId id);
+        void Unorder(EntryId id);
+        // Remove without the sibling unlink, for entries whose parent goes too
+        void MarkDead(EntryId id);
+        void Unlink(EntryId id);
+
+        // open-addressing table of ids keyed by (parent, name), linear probing;
+        // slots are placed by (parent, name hash) and confirmed by comparing
+        // the hash first and the name only when the hashes agree
+        std::size_t ChildSlot(EntryId parent, std::uint32_t name_hash) const;
+        void InsertChild(EntryId id);
+        void EraseChild(EntryId id);
+        void GrowChildren();
+
+        std::filesystem::path root_path_;
+        std::uint64_t generation_ = 0;
+
+        ChunkedColumn<EntryId> parent_;
+        ChunkedColumn<EntryId> first_child_;
+        ChunkedColumn<EntryId> next_sibling_;
+        ChunkedColumn<std::uint32_t> name_offset_;
+        ChunkedColumn<std::uint16_t> name_length_;
+        ChunkedColumn<std::uint32_t> name_hash_;
+        ChunkedColumn<std::uint32_t> name_mask_;
+        ChunkedColumn<std::uint16_t> extension_;
+        ChunkedColumn<std::uint8_t> type_;
+        ChunkedColumn<std::uint64_t> size_;
+        ChunkedColumn<std::int64_t> mtime_;
+        // kept whole: the crawl compares them to reuse entries, and the
+        // index file stores them
+        ChunkedColumn<std::int64_t> ctime_;
+        ChunkedColumn<std::uint64_t> inode_;
+
+        StringArena names_;
+        // Same layout as names_, byte for byte lowercase, so name_offset_ is
+        // valid in both. Names of dead entries stay behind until the store
+        // is compacted.
+        StringArena lower_names_;
+        TrigramIndex trigrams_;
+        // by type and by extension id, grown on demand
+        std::vector<RoaringBitmap> type_bitmaps_;
+        std::vector<RoaringBitmap> extension_bitmaps_;
+        // by IsDirectory
+        OrderedIndex size_order_[2];
+        OrderedIndex mtime_order_[2];
+        bool ordered_ = false;
+        ChunkedColumn<EntryId> child_slots_;
+        std::size_t child_count_ = 0;
+
+        // grows by a few entries after the first crawl, so a copy that
+        // interns one clones the whole table
+        struct Extensions {
+            std::vector<std::string> names;
+            std::vector<std::uint8_t> types;
+            std::unordered_map<std::string, std::uint16_t> ids;
+        };
+        std::shared_ptr<Extensions> extensions_ = std::make_shared<Extensions>();
+
+        std::size_t live_files_ = 0;
+        std::size_t live_dirs_ = 0;
+    };
+
+    // One published version of the index. Never modified after publishing;
+    // it is freed when the last reader lets go of it.
+    using IndexSnapshot = std::shared_ptr<const IndexStore>;
+}
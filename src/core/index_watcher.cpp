@@ -0,0 +1,373 @@
+#include "index_watcher.h"
+#include <iostream>
+#include <chrono>
+#include <cstring>
+#include <algorithm>
+
+#if defined(__linux__)
+#include <sys/inotify.h>
+#include <poll.h>
+#include <unistd.h>
+#endif
+
+namespace fileindexer
+{
+    namespace
+    {
+        // how long the thread keeps collecting after the first event of a batch
+        constexpr auto COALESCE_WINDOW = std::chrono::milliseconds(50);
+        constexpr size_t MAX_BATCH = 4096;
+        // how often subtrees without watches are polled
+        constexpr auto UNWATCHED_RESCAN_INTERVAL = std::chrono::seconds(30);
+        constexpr int POLL_TIMEOUT_MS = 100;
+    }
+
+    bool IsWithin(const std::filesystem::path &p, const std::filesystem::path &dir)
+    {
+        const auto &a = p.native();
+        const auto &b = dir.native();
+        if (a.size() < b.size() || a.compare(0, b.size(), b) != 0)
+            return false;
+        if (a.size() == b.size())
+            return true;
+        return b.empty() || b.back() == std::filesystem::path::preferred_separator ||
+               a[b.size()] == std::filesystem::path::preferred_separator;
+    }
+
+    IndexWatcher::~IndexWatcher()
+    {
+        Stop();
+    }
+
+    void IndexWatcher::Stop()
+    {
+        std::lock_guard<std::mutex> control(control_mutex_);
+        StopLocked();
+    }
+
+    std::filesystem::path IndexWatcher::Root() const
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return root_;
+    }
+
+    bool IndexWatcher::InUnwatchedRegion(const std::filesystem::path &dir) const
+    {
+        return std::any_of(unwatched_regions_.begin(), unwatched_regions_.end(),
+                           [&](const std::filesystem::path &region) { return IsWithin(dir, region); });
+    }
+
+#if defined(__linux__)
+
+    void IndexWatcher::RenameWatches(const std::filesystem::path &from, const std::filesystem::path &to)
+    {
+        auto rebase = [&](const std::filesystem::path &p)
+        {
+            return std::filesystem::path(to.native() + p.native().substr(from.native().size()));
+        };
+
+        // a directory renamed over another replaces it, and its watches go
+        // with it; they would otherwise resolve events to paths now taken
+        for (auto it = path_to_wd_.begin(); it != path_to_wd_.end();)
+        {
+            if (IsWithin(it->first, to) && !IsWithin(it->first, from))
+            {
+                inotify_rm_watch(fd_, it->second);
+                wd_to_path_.erase(it->second);
+                it = path_to_wd_.erase(it);
+            }
+            else
+            {
+                ++it;
+            }
+        }
+
+        std::vector<std::pair<std::filesystem::path, int>> moved;
+        for (auto it = path_to_wd_.begin(); it != path_to_wd_.end();)
+        {
+            if (IsWithin(it->first, from))
+            {
+                moved.emplace_back(rebase(it->first), it->second);
+                it = path_to_wd_.erase(it);
+            }
+            else
+            {
+                ++it;
+            }
+        }
+        for (auto &[path, wd] : moved)
+        {
+            wd_to_path_[wd] = path;
+            path_to_wd_[std::move(path)] = wd;
+        }
+
+        for (auto &region : unwatched_regions_)
+        {
+            if (IsWithin(region, from))
+                region = rebase(region);
+        }
+    }
+
+    bool IndexWatcher::Start(const std::filesystem::path &root, WatchBatchCallback on_batch)
+    {
+        std::lock_guard<std::mutex> control(control_mutex_);
+        StopLocked();
+
+        fd_ = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+        if (fd_ < 0)
+        {
+            std::cerr << "inotify unavailable: " << std::strerror(errno) << "\n";
+            return false;
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            root_ = root;
+        }
+        on_batch_ = std::move(on_batch);
+        running_ = true;
+        thread_ = std::thread(&IndexWatcher::Run, this);
+        return true;
+    }
+
+    void IndexWatcher::StopLocked()
+    {
+        running_ = false;
+        if (thread_.joinable())
+            thread_.join();
+
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (fd_ >= 0)
+        {
+            close(fd_);
+            fd_ = -1;
+        }
+        wd_to_path_.clear();
+        path_to_wd_.clear();
+        unwatched_regions_.clear();
+        rescan_requests_.clear();
+        root_.clear();
+    }
+
+    void IndexWatcher::Watch(const std::filesystem::path &dir)
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (fd_ < 0 || path_to_wd_.count(dir) || InUnwatchedRegion(dir))
+            return;
+
+        const uint32_t mask = IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO |
+                              IN_MODIFY | IN_CLOSE_WRITE | IN_ATTRIB |
+                              IN_DELETE_SELF | IN_MOVE_SELF | IN_ONLYDIR | IN_EXCL_UNLINK;
+
+        int wd = inotify_add_watch(fd_, dir.c_str(), mask);
+        if (wd < 0)
+        {
+            if (errno == ENOSPC)
+            {
+                std::cerr << "inotify watch limit reached, polling " << dir << " instead\n";
+                unwatched_regions_.push_back(dir);
+            }
+            return;
+        }
+
+        wd_to_path_[wd] = dir;
+        path_to_wd_[dir] = wd;
+    }
+
+    void IndexWatcher::Unwatch(const std::filesystem::path &dir)
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        for (auto it = path_to_wd_.begin(); it != path_to_wd_.end();)
+        {
+            if (IsWithin(it->first, dir))
+            {
+                inotify_rm_watch(fd_, it->second);
+                wd_to_path_.erase(it->second);
+                it = path_to_wd_.erase(it);
+            }
+            else
+            {
+                ++it;
+            }
+        }
+        unwatched_regions_.erase(std::remove_if(unwatched_regions_.begin(), unwatched_regions_.end(),
+                                                [&](const std::filesystem::path &region) { return IsWithin(region, dir); }),
+                                 unwatched_regions_.end());
+    }
+
+    void IndexWatcher::RequestRescan(const std::filesystem::path &dir)
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        rescan_requests_.push_back(dir);
+    }
+
+    void IndexWatcher::Run()
+    {
+        alignas(inotify_event) char buffer[64 * 1024];
+
+        std::vector<WatchEvent> batch;
+        std::unordered_map<std::filesystem::path, size_t, PathHash> batch_slots;
+        // IN_MOVED_FROM paths by cookie, waiting for their IN_MOVED_TO
+        std::unordered_map<uint32_t, std::filesystem::path> moved_from;
+        auto last_region_rescan = std::chrono::steady_clock::now();
+
+        auto add = [&](WatchEvent::Kind kind, std::filesystem::path path)
+        {
+            auto [it, inserted] = batch_slots.emplace(path, batch.size());
+            if (inserted)
+                batch.push_back({kind, std::move(path), {}});
+            else if (kind > batch[it->second].kind)
+                batch[it->second].kind = kind; // CREATED beats CHANGED, RESCAN beats everything
+        };
+
+        // drains whatever the kernel has queued; false once nothing was read
+        auto drain = [&]() -> bool
+        {
+            ssize_t len = read(fd_, buffer, sizeof(buffer));
+            if (len <= 0)
+                return false;
+
+            std::lock_guard<std::mutex> lock(mutex_);
+            for (char *p = buffer; p < buffer + len;)
+            {
+                auto *event = reinterpret_cast<inotify_event *>(p);
+                p += sizeof(inotify_event) + event->len;
+
+                if (event->mask & IN_Q_OVERFLOW)
+                {
+                    // no way to tell what was lost, so the whole root is suspect
+                    add(WatchEvent::RESCAN, root_);
+                    continue;
+                }
+
+                auto wd_it = wd_to_path_.find(event->wd);
+                if (wd_it == wd_to_path_.end())
+                    continue;
+                const std::filesystem::path dir = wd_it->second;
+
+                if (event->mask & IN_IGNORED)
+                {
+                    // the path may already belong to a watch that was moved there
+                    auto path_it = path_to_wd_.find(dir);
+                    if (path_it != path_to_wd_.end() && path_it->second == event->wd)
+                        path_to_wd_.erase(path_it);
+                    wd_to_path_.erase(wd_it);
+                    continue;
+                }
+
+                if (event->mask & (IN_DELETE_SELF | IN_MOVE_SELF))
+                {
+                    add(WatchEvent::CHANGED, dir);
+                    continue;
+                }
+
+                if (event->len == 0)
+                    continue;
+
+                auto path = dir / event->name;
+                if (event->mask & IN_MOVED_FROM)
+                {
+                    // reported as gone unless the matching IN_MOVED_TO shows up
+                    moved_from[event->cookie] = path;
+                    add(WatchEvent::CHANGED, std::move(path));
+                }
+                else if (event->mask & IN_MOVED_TO)
+                {
+                    auto from = moved_from.find(event->cookie);
+                    auto slot = from != moved_from.end() ? batch_slots.find(from->second) : batch_slots.end();
+                    if (slot != batch_slots.end() && batch[slot->second].kind == WatchEvent::CHANGED)
+                    {
+                        // a rename inside the tree: one relink instead of a
+                        // delete plus a crawl of whatever was moved
+                        size_t index = slot->second;
+                        batch_slots.erase(slot);
+                        RenameWatches(from->second, path);
+                        batch[index] = {WatchEvent::MOVED, path, std::move(from->second)};
+                        batch_slots[std::move(path)] = index;
+                        moved_from.erase(from);
+                    }
+                    else
+                    {
+                        add(WatchEvent::CREATED, std::move(path));
+                    }
+                }
+                else if (event->mask & IN_CREATE)
+                {
+                    add(WatchEvent::CREATED, std::move(path));
+                }
+                else
+                {
+                    add(WatchEvent::CHANGED, std::move(path));
+                }
+            }
+            return true;
+        };
+
+        while (running_)
+        {
+            pollfd pfd{fd_, POLLIN, 0};
+            int ready = poll(&pfd, 1, POLL_TIMEOUT_MS);
+
+            if (ready > 0 && drain())
+            {
+                // give a burst (untar, git checkout) a moment to finish so it
+                // lands in one batch instead of hundreds
+                auto deadline = std::chrono::steady_clock::now() + COALESCE_WINDOW;
+                while (running_ && batch.size() < MAX_BATCH && std::chrono::steady_clock::now() < deadline)
+                {
+                    pfd.revents = 0;
+                    if (poll(&pfd, 1, 10) > 0)
+                        drain();
+                }
+            }
+
+            std::vector<std::filesystem::path> requested;
+            {
+                std::lock_guard<std::mutex> lock(mutex_);
+                requested.swap(rescan_requests_);
+            }
+            for (auto &dir : requested)
+                add(WatchEvent::RESCAN, std::move(dir));
+
+            auto now = std::chrono::steady_clock::now();
+            if (now - last_region_rescan >= UNWATCHED_RESCAN_INTERVAL)
+            {
+                last_region_rescan = now;
+                std::vector<std::filesystem::path> regions;
+                {
+                    std::lock_guard<std::mutex> lock(mutex_);
+                    regions = unwatched_regions_;
+                }
+                for (auto &region : regions)
+                    add(WatchEvent::RESCAN, std::move(region));
+            }
+
+            if (!batch.empty() && running_)
+            {
+                on_batch_(batch);
+                batch.clear();
+                batch_slots.clear();
+                moved_from.clear();
+            }
+        }
+    }
+
+#else
+
+    bool IndexWatcher::Start(const std::filesystem::path &, WatchBatchCallback)
+    {
+        return false;
+    }
+
+    void IndexWatcher::StopLocked()
+    {
+        running_ = false;
+    }
+
+    void IndexWatcher::Watch(const std::filesystem::path &) {}
+    void IndexWatcher::Unwatch(const std::filesystem::path &) {}
+    void IndexWatcher::RequestRescan(const std::filesystem::path &) {}
+    void IndexWatcher::Run() {}
+
+#endif
+}
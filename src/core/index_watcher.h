@@ -0,0 +1,88 @@
+#pragma once
+
+#include <atomic>
+#include <filesystem>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+#include "index_store.h"
+
+namespace fileindexer {
+
+    struct WatchEvent {
+        enum Kind
+        {
+            CHANGED, // something happened to path; re-stat it (it may be gone)
+            CREATED, // path appeared; a directory has to be crawled
+            MOVED,   // from was renamed to path within the watched tree
+            RESCAN   // events were lost for this subtree; reindex it incrementally
+        };
+
+        Kind kind;
+        std::filesystem::path path;
+        std::filesystem::path from; // MOVED only
+    };
+
+    // Called on the watcher thread with one coalesced batch; every path shows
+    // up at most once per batch.
+    using WatchBatchCallback = std::function<void(std::vector<WatchEvent>&)>;
+
+    // Keeps inotify watches on indexed directories and hands batched changes
+    // back to the indexer. When the kernel queue overflows the whole root is
+    // reported for a rescan; when the watch limit is hit the subtree that could
+    // not be watched is rescanned periodically instead. Does nothing off Linux.
+    //
+    // Start and Stop may be called from any thread; they are serialized, so
+    // a restart never races another one or a shutdown.
+    class IndexWatcher
+    {
+    public:
+        ~IndexWatcher();
+
+        bool Start(const std::filesystem::path& root, WatchBatchCallback on_batch);
+        void Stop();
+
+        bool IsRunning() const { return running_; }
+        std::filesystem::path Root() const;
+
+        // true while Stop has not been requested, used to cancel rescans
+        const std::atomic<bool>& KeepRunning() const { return running_; }
+
+        void Watch(const std::filesystem::path& dir);
+        // drops the watches on dir and every directory below it
+        void Unwatch(const std::filesystem::path& dir);
+
+        // queues a rescan of dir on the watcher thread
+        void RequestRescan(const std::filesystem::path& dir);
+
+    private:
+        // Stop's work; caller holds control_mutex_
+        void StopLocked();
+        void Run();
+        bool InUnwatchedRegion(const std::filesystem::path& dir) const;
+        // Points the watches below from at their new paths, dropping the
+        // watches of whatever the rename replaced at to; caller holds mutex_
+        void RenameWatches(const std::filesystem::path& from, const std::filesystem::path& to);
+
+        int fd_ = -1;
+        std::filesystem::path root_;
+        WatchBatchCallback on_batch_;
+        std::thread thread_;
+        std::atomic<bool> running_{false};
+        // serializes Start and Stop, which own fd_, on_batch_ and thread_
+        std::mutex control_mutex_;
+
+        mutable std::mutex mutex_;
+        std::unordered_map<int, std::filesystem::path> wd_to_path_;
+        std::unordered_map<std::filesystem::path, int, PathHash> path_to_wd_;
+        // subtrees the kernel refused to watch; rescanned on a timer
+        std::vector<std::filesystem::path> unwatched_regions_;
+        // queued by RequestRescan for the next batch
+        std::vector<std::filesystem::path> rescan_requests_;
+    };
+
+    // p is dir itself or lies somewhere below it
+    bool IsWithin(const std::filesystem::path& p, const std::filesystem::path& dir);
+}
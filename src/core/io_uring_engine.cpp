@@ -0,0 +1,336 @@
+#include "io_uring_engine.h"
+
+#if defined(__linux__)
+
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sched.h>
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <iostream>
+#include <memory>
+#include <vector>
+
+// Talks to the kernel directly instead of pulling in liburing; the crawler
+// only needs submit-and-wait on two opcodes.
+
+namespace fileindexer
+{
+    namespace
+    {
+        constexpr unsigned RING_ENTRIES = 256;
+
+        int SysSetup(unsigned entries, io_uring_params *params)
+        {
+            return static_cast<int>(syscall(__NR_io_uring_setup, entries, params));
+        }
+
+        int SysEnter(int fd, unsigned to_submit, unsigned min_complete, unsigned flags)
+        {
+            return static_cast<int>(syscall(__NR_io_uring_enter, fd, to_submit, min_complete, flags, nullptr, 0));
+        }
+
+        int SysRegister(int fd, unsigned opcode, void *arg, unsigned nr_args)
+        {
+            return static_cast<int>(syscall(__NR_io_uring_register, fd, opcode, arg, nr_args));
+        }
+
+        class Ring
+        {
+        public:
+            ~Ring()
+            {
+                if (sqes_ != MAP_FAILED) munmap(sqes_, sqes_len_);
+                if (cq_ptr_ != MAP_FAILED && cq_ptr_ != sq_ptr_) munmap(cq_ptr_, cq_len_);
+                if (sq_ptr_ != MAP_FAILED) munmap(sq_ptr_, sq_len_);
+                if (fd_ >= 0) close(fd_);
+            }
+
+            bool Init(unsigned entries)
+            {
+                io_uring_params params;
+                std::memset(&params, 0, sizeof(params));
+
+                fd_ = SysSetup(entries, &params);
+                if (fd_ < 0)
+                    return false;
+
+                sq_len_ = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+                cq_len_ = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+                bool single_mmap = params.features & IORING_FEAT_SINGLE_MMAP;
+                if (single_mmap)
+                    sq_len_ = cq_len_ = std::max(sq_len_, cq_len_);
+
+                sq_ptr_ = mmap(nullptr, sq_len_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd_, IORING_OFF_SQ_RING);
+                if (sq_ptr_ == MAP_FAILED)
+                    return false;
+
+                cq_ptr_ = single_mmap ? sq_ptr_
+                                      : mmap(nullptr, cq_len_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd_, IORING_OFF_CQ_RING);
+                if (cq_ptr_ == MAP_FAILED)
+                    return false;
+
+                sqes_len_ = params.sq_entries * sizeof(io_uring_sqe);
+                sqes_ = mmap(nullptr, sqes_len_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd_, IORING_OFF_SQES);
+                if (sqes_ == MAP_FAILED)
+                    return false;
+
+                auto *sq = static_cast<char *>(sq_ptr_);
+                sq_head_ = reinterpret_cast<unsigned *>(sq + params.sq_off.head);
+                sq_tail_ = reinterpret_cast<unsigned *>(sq + params.sq_off.tail);
+                sq_mask_ = *reinterpret_cast<unsigned *>(sq + params.sq_off.ring_mask);
+                sq_array_ = reinterpret_cast<unsigned *>(sq + params.sq_off.array);
+
+                auto *cq = static_cast<char *>(cq_ptr_);
+                cq_head_ = reinterpret_cast<unsigned *>(cq + params.cq_off.head);
+                cq_tail_ = reinterpret_cast<unsigned *>(cq + params.cq_off.tail);
+                cq_mask_ = *reinterpret_cast<unsigned *>(cq + params.cq_off.ring_mask);
+                cqes_ = reinterpret_cast<io_uring_cqe *>(cq + params.cq_off.cqes);
+
+                capacity_ = params.sq_entries;
+                return true;
+            }
+
+            bool Supports(unsigned opcode_a, unsigned opcode_b)
+            {
+                std::vector<char> storage(sizeof(io_uring_probe) + 256 * sizeof(io_uring_probe_op), 0);
+                auto *probe = reinterpret_cast<io_uring_probe *>(storage.data());
+                if (SysRegister(fd_, IORING_REGISTER_PROBE, probe, 256) < 0)
+                    return false;
+
+                auto supported = [&](unsigned op)
+                {
+                    return op <= probe->last_op && (probe->ops[op].flags & IO_URING_OP_SUPPORTED);
+                };
+                return supported(opcode_a) && supported(opcode_b);
+            }
+
+            unsigned Capacity() const { return capacity_; }
+
+            io_uring_sqe *NextSqe()
+            {
+                unsigned tail = *sq_tail_;
+                unsigned index = tail & sq_mask_;
+                auto *sqe = static_cast<io_uring_sqe *>(sqes_) + index;
+                std::memset(sqe, 0, sizeof(*sqe));
+                sq_array_[index] = index;
+                __atomic_store_n(sq_tail_, tail + 1, __ATOMIC_RELEASE);
+                return sqe;
+            }
+
+            // Submits everything queued and blocks until that many completions
+            // arrived. On failure submitted tells how many the kernel took.
+            bool SubmitAndWait(unsigned count, unsigned &submitted)
+            {
+                submitted = 0;
+                while (submitted < count)
+                {
+                    int ret = SysEnter(fd_, count - submitted, count - submitted, IORING_ENTER_GETEVENTS);
+                    if (ret < 0)
+                    {
+                        if (errno == EINTR) continue;
+                        return false;
+                    }
+                    submitted += static_cast<unsigned>(ret);
+                }
+                return true;
+            }
+
+            // Forgets SQEs queued but never taken by the kernel, so the next
+            // submit does not send them along. Without SQPOLL only enter
+            // moves the kernel's head, so everything past it is still ours.
+            void DropUnsubmitted()
+            {
+                __atomic_store_n(sq_tail_, __atomic_load_n(sq_head_, __ATOMIC_ACQUIRE), __ATOMIC_RELEASE);
+            }
+
+            template <typename Fn>
+            unsigned Reap(Fn &&on_completion)
+            {
+                unsigned head = *cq_head_;
+                unsigned tail = __atomic_load_n(cq_tail_, __ATOMIC_ACQUIRE);
+                unsigned reaped = 0;
+                for (; head != tail; ++head, ++reaped)
+                {
+                    const io_uring_cqe &cqe = cqes_[head & cq_mask_];
+                    on_completion(cqe.user_data, cqe.res);
+                }
+                __atomic_store_n(cq_head_, head, __ATOMIC_RELEASE);
+                return reaped;
+            }
+
+            bool WaitFor(unsigned count)
+            {
+                while (SysEnter(fd_, 0, count, IORING_ENTER_GETEVENTS) < 0)
+                {
+                    if (errno != EINTR)
+                        return false;
+                }
+                return true;
+            }
+
+        private:
+            int fd_ = -1;
+            void *sq_ptr_ = MAP_FAILED;
+            void *cq_ptr_ = MAP_FAILED;
+            void *sqes_ = MAP_FAILED;
+            size_t sq_len_ = 0;
+            size_t cq_len_ = 0;
+            size_t sqes_len_ = 0;
+            unsigned capacity_ = 0;
+
+            unsigned *sq_head_ = nullptr;
+            unsigned *sq_tail_ = nullptr;
+            unsigned sq_mask_ = 0;
+            unsigned *sq_array_ = nullptr;
+
+            unsigned *cq_head_ = nullptr;
+            unsigned *cq_tail_ = nullptr;
+            unsigned cq_mask_ = 0;
+            io_uring_cqe *cqes_ = nullptr;
+        };
+
+        // one ring per crawler thread, created on first use
+        Ring *ThreadRing()
+        {
+            thread_local std::unique_ptr<Ring> ring;
+            thread_local bool failed = false;
+            if (!ring && !failed)
+            {
+                auto candidate = std::make_unique<Ring>();
+                if (candidate->Init(RING_ENTRIES))
+                    ring = std::move(candidate);
+                else
+                    failed = true;
+            }
+            return ring.get();
+        }
+    }
+
+    bool IoUringAvailable()
+    {
+        static const bool available = []()
+        {
+            Ring ring;
+            if (!ring.Init(8))
+            {
+                std::cerr << "io_uring unavailable (" << std::strerror(errno) << "), using synchronous stat\n";
+                return false;
+            }
+            return ring.Supports(IORING_OP_STATX, IORING_OP_OPENAT);
+        }();
+        return available;
+    }
+
+    bool IoUringStatBatch(int dir_fd, StatxRequest *requests, std::size_t count)
+    {
+        if (!IoUringAvailable())
+            return false;
+
+        Ring *ring = ThreadRing();
+        if (!ring)
+            return false;
+
+        // user_data packs the request index and whether it is the open half
+        auto complete = [&](unsigned long long user_data, int res)
+        {
+            StatxRequest &req = requests[user_data >> 1];
+            if (user_data & 1)
+                req.open_result = res;
+            else
+                req.stat_result = res;
+        };
+
+        // Reaps until every submitted SQE has completed, so that after a
+        // failure the kernel no longer writes into requests and the next
+        // batch does not mistake these completions for its own. Polls if
+        // waiting keeps failing; completions arrive either way.
+        auto drain = [&](unsigned submitted, unsigned done)
+        {
+            done += ring->Reap(complete);
+            while (done < submitted)
+            {
+                if (!ring->WaitFor(submitted - done))
+                    sched_yield();
+                done += ring->Reap(complete);
+            }
+        };
+
+        // after a failure: close what the queued requests opened, since the
+        // caller redoes every request without the ring
+        std::size_t next = 0;
+        auto fail = [&]()
+        {
+            for (std::size_t i = 0; i < next; ++i)
+            {
+                if (requests[i].open_directory && requests[i].open_result >= 0)
+                    close(requests[i].open_result);
+                requests[i].open_result = -1;
+            }
+            return false;
+        };
+
+        while (next < count)
+        {
+            unsigned queued = 0;
+            while (next < count)
+            {
+                StatxRequest &req = requests[next];
+                unsigned needed = req.open_directory ? 2 : 1;
+                if (queued + needed > ring->Capacity())
+                    break;
+
+                req.stat_result = -EINPROGRESS;
+                req.open_result = -1;
+
+                io_uring_sqe *sqe = ring->NextSqe();
+                sqe->opcode = IORING_OP_STATX;
+                sqe->fd = dir_fd;
+                sqe->addr = reinterpret_cast<unsigned long long>(req.name);
+                sqe->len = STATX_FINGERPRINT_MASK;
+                sqe->off = reinterpret_cast<unsigned long long>(&req.stx);
+                sqe->statx_flags = static_cast<unsigned>(req.flags) | AT_STATX_SYNC_AS_STAT;
+                sqe->user_data = static_cast<unsigned long long>(next) << 1;
+
+                if (req.open_directory)
+                {
+                    io_uring_sqe *open_sqe = ring->NextSqe();
+                    open_sqe->opcode = IORING_OP_OPENAT;
+                    open_sqe->fd = dir_fd;
+                    open_sqe->addr = reinterpret_cast<unsigned long long>(req.name);
+                    open_sqe->open_flags = O_RDONLY | O_DIRECTORY | O_CLOEXEC | O_NOFOLLOW;
+                    open_sqe->user_data = (static_cast<unsigned long long>(next) << 1) | 1;
+                }
+
+                queued += needed;
+                ++next;
+            }
+
+            unsigned submitted = 0;
+            if (!ring->SubmitAndWait(queued, submitted))
+            {
+                ring->DropUnsubmitted();
+                drain(submitted, 0);
+                return fail();
+            }
+
+            unsigned done = ring->Reap(complete);
+            while (done < queued)
+            {
+                if (!ring->WaitFor(queued - done))
+                {
+                    drain(queued, done);
+                    return fail();
+                }
+                done += ring->Reap(complete);
+            }
+        }
+        return true;
+    }
+}
+
+#endif
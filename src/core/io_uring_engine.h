@@ -0,0 +1,39 @@
+#pragma once
+
+#if defined(__linux__)
+
+#include <cstddef>
+#include <sys/stat.h>
+
+namespace fileindexer {
+
+    // everything the crawler compares to decide whether an entry changed
+    constexpr unsigned STATX_FINGERPRINT_MASK = STATX_TYPE | STATX_MODE | STATX_SIZE | STATX_MTIME | STATX_INO | STATX_CTIME;
+
+    // One metadata lookup relative to a directory fd. When open_directory is
+    // set the entry is also opened with O_DIRECTORY in the same batch so the
+    // crawler can list it later without a blocking open.
+    struct StatxRequest {
+        const char* name;
+        int flags;
+        bool open_directory;
+
+        // filled in by IoUringStatBatch: 0 or -errno, and the opened fd or -errno
+        int stat_result;
+        int open_result;
+        struct statx stx;
+    };
+
+    // True when the kernel accepts io_uring and supports STATX and OPENAT.
+    // Probed once; seccomp-filtered or pre-5.6 kernels report false.
+    bool IoUringAvailable();
+
+    // Submits every request through this thread's ring in batches of up to the
+    // ring size and waits for all completions. Returns false if the ring could
+    // not be used or failed partway; every request that reached the kernel
+    // has completed by then and any directory it opened is closed again, so
+    // the caller can redo them all synchronously with the same buffers.
+    bool IoUringStatBatch(int dir_fd, StatxRequest* requests, std::size_t count);
+}
+
+#endif
@@ -0,0 +1,216 @@
+#include "name_scan.h"
+#include "trigram_index.h"
+#include <cstdint>
+#include <cstring>
+
+#if defined(__x86_64__) || defined(_M_X64)
+#define ANGLER_SCAN_X86 1
+#include <immintrin.h>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+#endif
+
+#if defined(ANGLER_SCAN_X86) && (defined(__GNUC__) || defined(__clang__))
+#define ANGLER_TARGET_AVX2 __attribute__((target("avx2")))
+#else
+#define ANGLER_TARGET_AVX2
+#endif
+
+namespace fileindexer
+{
+    namespace
+    {
+        using FindFn = std::size_t (*)(const char *hay, std::size_t size, const char *needle, std::size_t n, std::size_t from);
+
+        constexpr std::size_t NOT_FOUND = std::string_view::npos;
+
+        inline char UpperAscii(char c)
+        {
+            return (c >= 'a' && c <= 'z') ? static_cast<char>(c - ('a' - 'A')) : c;
+        }
+
+        // needle[0] and needle[n - 1] already matched at pos; CASELESS
+        // lowercases the haystack side, the needle is lowercase already
+        template <bool CASELESS>
+        inline bool MiddleMatches(const char *hay, std::size_t pos, const char *needle, std::size_t n)
+        {
+            if (!CASELESS)
+                return n <= 2 || std::memcmp(hay + pos + 1, needle + 1, n - 2) == 0;
+            for (std::size_t i = 1; i + 1 < n; ++i)
+            {
+                if (LowerAscii(hay[pos + i]) != needle[i])
+                    return false;
+            }
+            return true;
+        }
+
+        template <bool CASELESS>
+        std::size_t FindScalar(const char *hay, std::size_t size, const char *needle, std::size_t n, std::size_t from)
+        {
+            const char *end = hay + size - n + 1; // last possible start + 1
+            if (CASELESS)
+            {
+                for (std::size_t pos = from; hay + pos < end; ++pos)
+                {
+                    if (LowerAscii(hay[pos]) == needle[0] && LowerAscii(hay[pos + n - 1]) == needle[n - 1] &&
+                        MiddleMatches<true>(hay, pos, needle, n))
+                        return pos;
+                }
+                return NOT_FOUND;
+            }
+            for (const char *at = hay + from; at < end;)
+            {
+                at = static_cast<const char *>(std::memchr(at, needle[0], static_cast<std::size_t>(end - at)));
+                if (!at)
+                    return NOT_FOUND;
+                std::size_t pos = static_cast<std::size_t>(at - hay);
+                if (hay[pos + n - 1] == needle[n - 1] && MiddleMatches<false>(hay, pos, needle, n))
+                    return pos;
+                ++at;
+            }
+            return NOT_FOUND;
+        }
+
+        struct Kernel
+        {
+            FindFn find;
+            FindFn find_caseless;
+            const char *name;
+        };
+
+#if defined(ANGLER_SCAN_X86)
+
+        inline unsigned LowestBit(std::uint32_t mask)
+        {
+#if defined(_MSC_VER) && !defined(__clang__)
+            unsigned long index;
+            _BitScanForward(&index, mask);
+            return static_cast<unsigned>(index);
+#else
+            return static_cast<unsigned>(__builtin_ctz(mask));
+#endif
+        }
+
+        // SSE2 is part of x86-64, so this one needs no check. CASELESS
+        // compares the first and last byte against both cases of the needle's.
+        template <bool CASELESS>
+        std::size_t FindSse2(const char *hay, std::size_t size, const char *needle, std::size_t n, std::size_t from)
+        {
+            const __m128i first = _mm_set1_epi8(needle[0]);
+            const __m128i last = _mm_set1_epi8(needle[n - 1]);
+            const __m128i first_upper = _mm_set1_epi8(UpperAscii(needle[0]));
+            const __m128i last_upper = _mm_set1_epi8(UpperAscii(needle[n - 1]));
+
+            std::size_t pos = from;
+            for (; pos + n - 1 + 16 <= size; pos += 16)
+            {
+                __m128i block_first = _mm_loadu_si128(reinterpret_cast<const __m128i *>(hay + pos));
+                __m128i block_last = _mm_loadu_si128(reinterpret_cast<const __m128i *>(hay + pos + n - 1));
+                __m128i eq_first = _mm_cmpeq_epi8(first, block_first);
+                __m128i eq_last = _mm_cmpeq_epi8(last, block_last);
+                if (CASELESS)
+                {
+                    eq_first = _mm_or_si128(eq_first, _mm_cmpeq_epi8(first_upper, block_first));
+                    eq_last = _mm_or_si128(eq_last, _mm_cmpeq_epi8(last_upper, block_last));
+                }
+                auto mask = static_cast<std::uint32_t>(_mm_movemask_epi8(_mm_and_si128(eq_first, eq_last)));
+                while (mask)
+                {
+                    unsigned bit = LowestBit(mask);
+                    if (MiddleMatches<CASELESS>(hay, pos + bit, needle, n))
+                        return pos + bit;
+                    mask &= mask - 1;
+                }
+            }
+            return FindScalar<CASELESS>(hay, size, needle, n, pos);
+        }
+
+        template <bool CASELESS>
+        ANGLER_TARGET_AVX2 std::size_t FindAvx2(const char *hay, std::size_t size, const char *needle, std::size_t n, std::size_t from)
+        {
+            const __m256i first = _mm256_set1_epi8(needle[0]);
+            const __m256i last = _mm256_set1_epi8(needle[n - 1]);
+            const __m256i first_upper = _mm256_set1_epi8(UpperAscii(needle[0]));
+            const __m256i last_upper = _mm256_set1_epi8(UpperAscii(needle[n - 1]));
+
+            std::size_t pos = from;
+            for (; pos + n - 1 + 32 <= size; pos += 32)
+            {
+                __m256i block_first = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(hay + pos));
+                __m256i block_last = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(hay + pos + n - 1));
+                __m256i eq_first = _mm256_cmpeq_epi8(first, block_first);
+                __m256i eq_last = _mm256_cmpeq_epi8(last, block_last);
+                if (CASELESS)
+                {
+                    eq_first = _mm256_or_si256(eq_first, _mm256_cmpeq_epi8(first_upper, block_first));
+                    eq_last = _mm256_or_si256(eq_last, _mm256_cmpeq_epi8(last_upper, block_last));
+                }
+                auto mask = static_cast<std::uint32_t>(_mm256_movemask_epi8(_mm256_and_si256(eq_first, eq_last)));
+                while (mask)
+                {
+                    unsigned bit = LowestBit(mask);
+                    if (MiddleMatches<CASELESS>(hay, pos + bit, needle, n))
+                        return pos + bit;
+                    mask &= mask - 1;
+                }
+            }
+            return FindSse2<CASELESS>(hay, size, needle, n, pos);
+        }
+
+        bool HasAvx2()
+        {
+#if defined(_MSC_VER) && !defined(__clang__)
+            int info[4];
+            __cpuid(info, 1);
+            const bool os_saves_ymm = (info[2] & (1 << 27)) && (info[2] & (1 << 28)) && (_xgetbv(0) & 6) == 6;
+            if (!os_saves_ymm)
+                return false;
+            __cpuidex(info, 7, 0);
+            return (info[1] & (1 << 5)) != 0;
+#else
+            return __builtin_cpu_supports("avx2");
+#endif
+        }
+
+        const Kernel &ResolveKernel()
+        {
+            static const Kernel kernel = HasAvx2() ? Kernel{FindAvx2<false>, FindAvx2<true>, "avx2"}
+                                                   : Kernel{FindSse2<false>, FindSse2<true>, "sse2"};
+            return kernel;
+        }
+
+#else
+
+        const Kernel &ResolveKernel()
+        {
+            static const Kernel kernel{FindScalar<false>, FindScalar<true>, "scalar"};
+            return kernel;
+        }
+
+#endif
+    }
+
+    std::size_t FindLowered(std::string_view haystack, std::string_view needle, std::size_t from)
+    {
+        if (needle.empty())
+            return from <= haystack.size() ? from : NOT_FOUND;
+        if (from > haystack.size() || haystack.size() - from < needle.size())
+            return NOT_FOUND;
+        return ResolveKernel().find(haystack.data(), haystack.size(), needle.data(), needle.size(), from);
+    }
+
+    std::size_t FindIgnoringCase(std::string_view haystack, std::string_view lower_needle, std::size_t from)
+    {
+        if (lower_needle.empty())
+            return from <= haystack.size() ? from : NOT_FOUND;
+        if (from > haystack.size() || haystack.size() - from < lower_needle.size())
+            return NOT_FOUND;
+        return ResolveKernel().find_caseless(haystack.data(), haystack.size(), lower_needle.data(), lower_needle.size(), from);
+    }
+
+    const char *NameScanKernel()
+    {
+        return ResolveKernel().name;
+    }
+}
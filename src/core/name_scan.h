@@ -0,0 +1,25 @@
+#pragma once
+
+#include <cstddef>
+#include <string_view>
+
+namespace fileindexer {
+
+    // Position of the first occurrence of needle in haystack at or after
+    // from, or npos. Both sides are compared byte for byte, so callers pass
+    // lowercased text for case-insensitive search.
+    //
+    // Candidates are found by comparing the needle's first and last byte
+    // against 16 or 32 positions at once, and only those are checked in full.
+    // The widest kernel the CPU supports is picked on first use.
+    std::size_t FindLowered(std::string_view haystack, std::string_view needle, std::size_t from = 0);
+
+    // Same, for a haystack in any case: ASCII letters in it match either
+    // case of lower_needle's, which has to be lowercase already. Both cases
+    // of the first and last byte are compared per block, so mixed-case text
+    // such as file contents is searched without lowercasing it first.
+    std::size_t FindIgnoringCase(std::string_view haystack, std::string_view lower_needle, std::size_t from = 0);
+
+    // "avx2", "sse2" or "scalar", whichever FindLowered dispatches to
+    const char* NameScanKernel();
+}
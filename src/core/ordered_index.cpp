@@ -0,0 +1,127 @@
+#include "ordered_index.h"
+
+namespace fileindexer
+{
+    void OrderedIndex::Assign(std::vector<Item> items)
+    {
+        std::sort(items.begin(), items.end());
+        blocks_.clear();
+        size_ = items.size();
+
+        // half full, so the first inserts do not split right away
+        const std::size_t per_block = BLOCK_MAX / 2;
+        for (std::size_t i = 0; i < items.size(); i += per_block)
+        {
+            auto end = items.begin() + static_cast<std::ptrdiff_t>(std::min(items.size(), i + per_block));
+            blocks_.push_back(std::make_shared<Block>(items.begin() + static_cast<std::ptrdiff_t>(i), end));
+        }
+    }
+
+    void OrderedIndex::Clear()
+    {
+        blocks_.clear();
+        size_ = 0;
+    }
+
+    std::size_t OrderedIndex::BlockFor(const Item &item) const
+    {
+        auto it = std::lower_bound(blocks_.begin(), blocks_.end(), item,
+                                   [](const std::shared_ptr<Block> &block, const Item &i) { return block->back() < i; });
+        return it == blocks_.end() ? blocks_.size() - 1 : static_cast<std::size_t>(it - blocks_.begin());
+    }
+
+    OrderedIndex::Block &OrderedIndex::Writable(std::size_t b)
+    {
+        if (blocks_[b].use_count() > 1)
+            blocks_[b] = std::make_shared<Block>(*blocks_[b]); // still part of a published snapshot
+        return *blocks_[b];
+    }
+
+    void OrderedIndex::Insert(std::uint64_t key, EntryId id)
+    {
+        const Item item{key, id};
+        if (blocks_.empty())
+        {
+            blocks_.push_back(std::make_shared<Block>(1, item));
+            size_ = 1;
+            return;
+        }
+
+        const std::size_t b = BlockFor(item);
+        Block &block = Writable(b);
+        auto at = std::lower_bound(block.begin(), block.end(), item);
+        if (at != block.end() && *at == item)
+            return;
+        block.insert(at, item);
+        ++size_;
+
+        if (block.size() > BLOCK_MAX)
+        {
+            auto half = block.begin() + static_cast<std::ptrdiff_t>(block.size() / 2);
+            auto upper = std::make_shared<Block>(half, block.end());
+            block.erase(half, block.end());
+            blocks_.insert(blocks_.begin() + static_cast<std::ptrdiff_t>(b) + 1, std::move(upper));
+        }
+    }
+
+    void OrderedIndex::Erase(std::uint64_t key, EntryId id)
+    {
+        if (blocks_.empty())
+            return;
+
+        const Item item{key, id};
+        const std::size_t b = BlockFor(item);
+        auto found = std::lower_bound(blocks_[b]->begin(), blocks_[b]->end(), item);
+        if (found == blocks_[b]->end() || !(*found == item))
+            return;
+
+        Block &block = Writable(b);
+        block.erase(std::lower_bound(block.begin(), block.end(), item));
+        --size_;
+
+        if (block.empty())
+            blocks_.erase(blocks_.begin() + static_cast<std::ptrdiff_t>(b));
+        else if (b + 1 < blocks_.size() && block.size() + blocks_[b + 1]->size() <= BLOCK_MAX / 2)
+        {
+            // keep blocks from thinning out into many tiny ones
+            const Block &next = *blocks_[b + 1];
+            block.insert(block.end(), next.begin(), next.end());
+            blocks_.erase(blocks_.begin() + static_cast<std::ptrdiff_t>(b) + 1);
+        }
+    }
+
+    std::size_t OrderedIndex::CountBetween(std::uint64_t low, std::uint64_t high) const
+    {
+        if (blocks_.empty() || low > high)
+            return 0;
+
+        const Item from{low, 0};
+        const Item to{high, std::numeric_limits<EntryId>::max()};
+        const std::size_t first = BlockFor(from);
+        const std::size_t last = BlockFor(to);
+
+        auto below = [](const Block &block, const Item &item)
+        { return static_cast<std::size_t>(std::lower_bound(block.begin(), block.end(), item) - block.begin()); };
+        auto up_to = [](const Block &block, const Item &item)
+        { return static_cast<std::size_t>(std::upper_bound(block.begin(), block.end(), item) - block.begin()); };
+
+        if (first == last)
+        {
+            std::size_t end = up_to(*blocks_[last], to);
+            std::size_t begin = below(*blocks_[first], from);
+            return end > begin ? end - begin : 0;
+        }
+        std::size_t count = blocks_[first]->size() - below(*blocks_[first], from) + up_to(*blocks_[last], to);
+        for (std::size_t b = first + 1; b < last; ++b)
+            count += blocks_[b]->size();
+        return count;
+    }
+
+    std::size_t OrderedIndex::MemoryUsage() const
+    {
+        std::size_t bytes = blocks_.capacity() * sizeof(std::shared_ptr<Block>);
+        for (const auto &block : blocks_)
+            bytes += sizeof(Block) + block->capacity() * sizeof(Item);
+        return bytes;
+    }
+}
@@ -0,0 +1,100 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <memory>
+#include <vector>
+#include "trigram_index.h"
+
+namespace fileindexer {
+
+    // Entry ids kept sorted by a 64-bit key (ties by id), for "largest" and
+    // "most recent" views and for key ranges. Stored as a list of sorted
+    // blocks of at most BLOCK_MAX items, like the leaves of a B+ tree: a
+    // change moves at most one block's worth of items, and a lookup is a
+    // binary search over the blocks and then within one.
+    //
+    // Blocks are shared between copies and cloned by the first copy that
+    // changes one, as the trigram postings are, so copying the index for a
+    // new snapshot costs one pointer per block.
+    class OrderedIndex
+    {
+    public:
+        struct Item
+        {
+            std::uint64_t key;
+            EntryId id;
+
+            bool operator<(const Item& other) const
+            {
+                return key != other.key ? key < other.key : id < other.id;
+            }
+            bool operator==(const Item& other) const { return key == other.key && id == other.id; }
+        };
+
+        // replaces everything with items, in any order
+        void Assign(std::vector<Item> items);
+        void Insert(std::uint64_t key, EntryId id);
+        void Erase(std::uint64_t key, EntryId id);
+        void Clear();
+
+        std::size_t Size() const { return size_; }
+        // items with low <= key <= high, counted block by block
+        std::size_t CountBetween(std::uint64_t low, std::uint64_t high) const;
+
+        // Calls visit(item) for items with low <= key <= high, ascending, or
+        // descending when asked, until visit returns false.
+        template <typename Visit>
+        void VisitBetween(std::uint64_t low, std::uint64_t high, bool descending, Visit visit) const;
+
+        std::size_t MemoryUsage() const;
+
+    private:
+        using Block = std::vector<Item>;
+
+        static constexpr std::size_t BLOCK_MAX = 512;
+
+        // first block whose last item is not below item, or the last block
+        std::size_t BlockFor(const Item& item) const;
+        Block& Writable(std::size_t b);
+
+        std::vector<std::shared_ptr<Block>> blocks_;
+        std::size_t size_ = 0;
+    };
+
+    template <typename Visit>
+    void OrderedIndex::VisitBetween(std::uint64_t low, std::uint64_t high, bool descending, Visit visit) const
+    {
+        if (blocks_.empty() || low > high)
+            return;
+
+        if (!descending)
+        {
+            const Item from{low, 0};
+            for (std::size_t b = BlockFor(from); b < blocks_.size(); ++b)
+            {
+                const Block& block = *blocks_[b];
+                for (auto it = std::lower_bound(block.begin(), block.end(), from); it != block.end(); ++it)
+                {
+                    if (it->key > high || !visit(*it))
+                        return;
+                }
+            }
+            return;
+        }
+
+        const Item to{high, std::numeric_limits<EntryId>::max()};
+        for (std::size_t b = BlockFor(to) + 1; b-- > 0;)
+        {
+            const Block& block = *blocks_[b];
+            for (auto it = std::upper_bound(block.begin(), block.end(), to); it != block.begin();)
+            {
+                --it;
+                if (it->key < low || !visit(*it))
+                    return;
+            }
+        }
+    }
+}
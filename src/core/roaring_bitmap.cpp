@@ -0,0 +1,296 @@
+#include "roaring_bitmap.h"
+#include <algorithm>
+#include <iterator>
+
+#if defined(_MSC_VER) && !defined(__clang__)
+#include <intrin.h>
+#endif
+
+namespace fileindexer
+{
+    namespace
+    {
+        inline unsigned PopCount(std::uint64_t word)
+        {
+#if defined(_MSC_VER) && !defined(__clang__)
+            return static_cast<unsigned>(__popcnt64(word));
+#else
+            return static_cast<unsigned>(__builtin_popcountll(word));
+#endif
+        }
+
+        inline unsigned LowestBit(std::uint64_t word)
+        {
+#if defined(_MSC_VER) && !defined(__clang__)
+            unsigned long index;
+            _BitScanForward64(&index, word);
+            return static_cast<unsigned>(index);
+#else
+            return static_cast<unsigned>(__builtin_ctzll(word));
+#endif
+        }
+
+        std::uint16_t High(std::uint32_t value) { return static_cast<std::uint16_t>(value >> 16); }
+        std::uint16_t Low(std::uint32_t value) { return static_cast<std::uint16_t>(value & 0xFFFFu); }
+    }
+
+    bool RoaringBitmap::Container::Contains(std::uint16_t low) const
+    {
+        if (IsBitset())
+            return (bits[low >> 6] >> (low & 63)) & 1u;
+        return std::binary_search(array.begin(), array.end(), low);
+    }
+
+    void RoaringBitmap::ToBitset(Container &c)
+    {
+        c.bits.assign(BITSET_WORDS, 0);
+        for (std::uint16_t low : c.array)
+            c.bits[low >> 6] |= std::uint64_t{1} << (low & 63);
+        std::vector<std::uint16_t>().swap(c.array);
+    }
+
+    void RoaringBitmap::ToArray(Container &c)
+    {
+        c.array.clear();
+        c.array.reserve(c.cardinality);
+        for (std::size_t w = 0; w < c.bits.size(); ++w)
+        {
+            for (std::uint64_t word = c.bits[w]; word; word &= word - 1)
+                c.array.push_back(static_cast<std::uint16_t>((w << 6) | LowestBit(word)));
+        }
+        std::vector<std::uint64_t>().swap(c.bits);
+    }
+
+    RoaringBitmap::Containers::iterator RoaringBitmap::Lower(std::uint16_t key)
+    {
+        return std::lower_bound(containers_.begin(), containers_.end(), key,
+                                [](const std::shared_ptr<Container> &c, std::uint16_t k) { return c->key < k; });
+    }
+
+    RoaringBitmap::Containers::const_iterator RoaringBitmap::Lower(std::uint16_t key) const
+    {
+        return std::lower_bound(containers_.begin(), containers_.end(), key,
+                                [](const std::shared_ptr<Container> &c, std::uint16_t k) { return c->key < k; });
+    }
+
+    RoaringBitmap::Container &RoaringBitmap::Writable(std::shared_ptr<Container> &c)
+    {
+        if (c.use_count() > 1)
+            c = std::make_shared<Container>(*c); // still part of a published snapshot
+        return *c;
+    }
+
+    void RoaringBitmap::Add(std::uint32_t value)
+    {
+        const std::uint16_t key = High(value);
+        const std::uint16_t low = Low(value);
+
+        // ids are handed out in order, so the last container is the usual hit
+        auto it = !containers_.empty() && containers_.back()->key == key ? containers_.end() - 1 : Lower(key);
+        if (it == containers_.end() || (*it)->key != key)
+        {
+            it = containers_.insert(it, std::make_shared<Container>());
+            (*it)->key = key;
+        }
+
+        Container &c = Writable(*it);
+        if (c.IsBitset())
+        {
+            std::uint64_t &word = c.bits[low >> 6];
+            const std::uint64_t bit = std::uint64_t{1} << (low & 63);
+            if (!(word & bit))
+            {
+                word |= bit;
+                ++c.cardinality;
+            }
+            return;
+        }
+
+        if (c.array.empty() || c.array.back() < low)
+            c.array.push_back(low);
+        else
+        {
+            auto at = std::lower_bound(c.array.begin(), c.array.end(), low);
+            if (*at == low)
+                return;
+            c.array.insert(at, low);
+        }
+        if (++c.cardinality > ARRAY_MAX)
+            ToBitset(c);
+    }
+
+    void RoaringBitmap::Remove(std::uint32_t value)
+    {
+        auto it = Lower(High(value));
+        const std::uint16_t low = Low(value);
+        if (it == containers_.end() || (*it)->key != High(value) || !(*it)->Contains(low))
+            return;
+
+        Container &c = Writable(*it);
+        if (c.IsBitset())
+        {
+            c.bits[low >> 6] &= ~(std::uint64_t{1} << (low & 63));
+            if (--c.cardinality <= ARRAY_MAX)
+                ToArray(c);
+        }
+        else
+        {
+            c.array.erase(std::lower_bound(c.array.begin(), c.array.end(), low));
+            --c.cardinality;
+        }
+
+        if (c.cardinality == 0)
+            containers_.erase(it);
+    }
+
+    bool RoaringBitmap::Contains(std::uint32_t value) const
+    {
+        auto it = Lower(High(value));
+        return it != containers_.end() && (*it)->key == High(value) && (*it)->Contains(Low(value));
+    }
+
+    std::size_t RoaringBitmap::Cardinality() const
+    {
+        std::size_t total = 0;
+        for (const auto &c : containers_)
+            total += c->cardinality;
+        return total;
+    }
+
+    RoaringBitmap::Container RoaringBitmap::Intersect(const Container &a, const Container &b)
+    {
+        Container out;
+        out.key = a.key;
+        if (a.IsBitset() && b.IsBitset())
+        {
+            out.bits.resize(BITSET_WORDS);
+            for (std::size_t w = 0; w < BITSET_WORDS; ++w)
+            {
+                out.bits[w] = a.bits[w] & b.bits[w];
+                out.cardinality += PopCount(out.bits[w]);
+            }
+            if (out.cardinality <= ARRAY_MAX)
+                ToArray(out);
+            return out;
+        }
+        if (a.IsBitset() || b.IsBitset())
+        {
+            // probe the bitset with every value of the array
+            const Container &array = a.IsBitset() ? b : a;
+            const Container &bitset = a.IsBitset() ? a : b;
+            for (std::uint16_t low : array.array)
+            {
+                if (bitset.Contains(low))
+                    out.array.push_back(low);
+            }
+        }
+        else
+            std::set_intersection(a.array.begin(), a.array.end(), b.array.begin(), b.array.end(), std::back_inserter(out.array));
+        out.cardinality = static_cast<std::uint32_t>(out.array.size());
+        return out;
+    }
+
+    RoaringBitmap::Container RoaringBitmap::Unite(const Container &a, const Container &b)
+    {
+        Container out;
+        out.key = a.key;
+        if (!a.IsBitset() && !b.IsBitset() && a.cardinality + b.cardinality <= ARRAY_MAX)
+        {
+            std::set_union(a.array.begin(), a.array.end(), b.array.begin(), b.array.end(), std::back_inserter(out.array));
+            out.cardinality = static_cast<std::uint32_t>(out.array.size());
+            return out;
+        }
+
+        out.bits.assign(BITSET_WORDS, 0);
+        for (const Container *c : {&a, &b})
+        {
+            if (c->IsBitset())
+            {
+                for (std::size_t w = 0; w < BITSET_WORDS; ++w)
+                    out.bits[w] |= c->bits[w];
+            }
+            else
+            {
+                for (std::uint16_t low : c->array)
+                    out.bits[low >> 6] |= std::uint64_t{1} << (low & 63);
+            }
+        }
+        for (std::uint64_t word : out.bits)
+            out.cardinality += PopCount(word);
+        if (out.cardinality <= ARRAY_MAX)
+            ToArray(out);
+        return out;
+    }
+
+    RoaringBitmap &RoaringBitmap::operator|=(const RoaringBitmap &other)
+    {
+        Containers merged;
+        merged.reserve(containers_.size() + other.containers_.size());
+        auto a = containers_.begin();
+        auto b = other.containers_.begin();
+        while (a != containers_.end() || b != other.containers_.end())
+        {
+            if (b == other.containers_.end() || (a != containers_.end() && (*a)->key < (*b)->key))
+                merged.push_back(std::move(*a++));
+            else if (a == containers_.end() || (*b)->key < (*a)->key)
+                merged.push_back(*b++);
+            else
+                merged.push_back(std::make_shared<Container>(Unite(**a++, **b++)));
+        }
+        containers_ = std::move(merged);
+        return *this;
+    }
+
+    RoaringBitmap &RoaringBitmap::operator&=(const RoaringBitmap &other)
+    {
+        Containers kept;
+        auto b = other.containers_.begin();
+        for (const auto &a : containers_)
+        {
+            while (b != other.containers_.end() && (*b)->key < a->key)
+                ++b;
+            if (b == other.containers_.end())
+                break;
+            if ((*b)->key != a->key)
+                continue;
+            Container both = Intersect(*a, **b);
+            if (both.cardinality != 0)
+                kept.push_back(std::make_shared<Container>(std::move(both)));
+        }
+        containers_ = std::move(kept);
+        return *this;
+    }
+
+    std::vector<std::uint32_t> RoaringBitmap::ToVector() const
+    {
+        std::vector<std::uint32_t> out;
+        out.reserve(Cardinality());
+        for (const auto &container : containers_)
+        {
+            const Container &c = *container;
+            const std::uint32_t high = static_cast<std::uint32_t>(c.key) << 16;
+            if (c.IsBitset())
+            {
+                for (std::size_t w = 0; w < c.bits.size(); ++w)
+                {
+                    for (std::uint64_t word = c.bits[w]; word; word &= word - 1)
+                        out.push_back(high | static_cast<std::uint32_t>((w << 6) | LowestBit(word)));
+                }
+            }
+            else
+            {
+                for (std::uint16_t low : c.array)
+                    out.push_back(high | low);
+            }
+        }
+        return out;
+    }
+
+    std::size_t RoaringBitmap::MemoryUsage() const
+    {
+        std::size_t bytes = containers_.capacity() * sizeof(std::shared_ptr<Container>);
+        for (const auto &c : containers_)
+            bytes += sizeof(Container) + c->array.capacity() * sizeof(std::uint16_t) + c->bits.capacity() * sizeof(std::uint64_t);
+        return bytes;
+    }
+}
@@ -0,0 +1,67 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+namespace fileindexer {
+
+    // Compressed set of 32-bit ids in the style of Roaring: ids are split by
+    // their high 16 bits into containers, and each container holds its low
+    // halves either as a sorted array (up to 4096 of them, 2 bytes each) or
+    // as a 65536-bit bitset (8 KB), whichever is smaller. Sparse sets such as
+    // one rare extension cost 2 bytes per id, dense ones such as "every
+    // file" cost one bit, and intersections work container by container.
+    // Containers are shared between copies and cloned by the first copy
+    // that changes one, so copying a bitmap costs a pointer per container.
+    class RoaringBitmap
+    {
+    public:
+        void Add(std::uint32_t value);
+        void Remove(std::uint32_t value);
+        bool Contains(std::uint32_t value) const;
+        std::size_t Cardinality() const;
+        bool Empty() const { return containers_.empty(); }
+
+        RoaringBitmap& operator|=(const RoaringBitmap& other);
+        RoaringBitmap& operator&=(const RoaringBitmap& other);
+
+        // ascending
+        std::vector<std::uint32_t> ToVector() const;
+
+        std::size_t MemoryUsage() const;
+
+    private:
+        // an array turns into a bitset past this many values and back again
+        // when it drops to it; above it the bitset is the smaller one
+        static constexpr std::size_t ARRAY_MAX = 4096;
+        static constexpr std::size_t BITSET_WORDS = 65536 / 64;
+
+        struct Container
+        {
+            std::uint16_t key = 0;
+            std::uint32_t cardinality = 0;
+            // exactly one of the two is in use
+            std::vector<std::uint16_t> array;
+            std::vector<std::uint64_t> bits;
+
+            bool IsBitset() const { return !bits.empty(); }
+            bool Contains(std::uint16_t low) const;
+        };
+
+        static void ToBitset(Container& c);
+        static void ToArray(Container& c);
+        static Container Intersect(const Container& a, const Container& b);
+        static Container Unite(const Container& a, const Container& b);
+
+        using Containers = std::vector<std::shared_ptr<Container>>;
+
+        // first container whose key is not below key
+        Containers::iterator Lower(std::uint16_t key);
+        Containers::const_iterator Lower(std::uint16_t key) const;
+        static Container& Writable(std::shared_ptr<Container>& c);
+
+        Containers containers_;
+    };
+}
@@ -0,0 +1,494 @@
+#include "search_engine.h"
+#include "fuzzy_match.h"
+#include "name_scan.h"
+#include <algorithm>
+#include <filesystem>
+#include <limits>
+
+namespace fileindexer
+{
+    namespace
+    {
+        // trigram candidates verified per task
+        constexpr std::size_t CANDIDATES_PER_SHARD = 16384;
+        // ids a fuzzy task walks; most are rejected by their mask alone
+        constexpr std::size_t ENTRIES_PER_SHARD = 65536;
+        // earlier queries kept for refining; deeper than anyone types
+        constexpr std::size_t MAX_HISTORY = 64;
+        // Checking a candidate id touches several columns at random, while
+        // the arena scan streams; below this fraction of the index a cached
+        // set still beats rescanning everything.
+        constexpr std::size_t SCAN_OVER_CANDIDATES_RATIO = 16;
+        // a cached set this small is verified faster than postings intersect
+        constexpr std::size_t SMALL_CANDIDATE_SET = 1024;
+
+        // Smaller is better: a hit at the start of the name beats one inside
+        // it, then shorter names win, then the id decides. Packed so a heap
+        // of plain integers orders hits and carries the id along.
+        std::uint64_t Rank(std::size_t match_pos, std::size_t name_length, EntryId id)
+        {
+            std::uint64_t inside = match_pos == 0 ? 0 : 1;
+            return (inside << 48) | (static_cast<std::uint64_t>(std::min<std::size_t>(name_length, 0xFFFF)) << 32) | id;
+        }
+
+        // Higher scores first, then shorter names, then the id.
+        std::uint64_t FuzzyRank(int score, std::size_t name_length, EntryId id)
+        {
+            auto worse = static_cast<std::uint64_t>(0xFFFF - std::clamp(score, 0, 0xFFFF));
+            return (worse << 48) | (static_cast<std::uint64_t>(std::min<std::size_t>(name_length, 0xFFFF)) << 32) | id;
+        }
+
+        EntryId RankedId(std::uint64_t rank)
+        {
+            return static_cast<EntryId>(rank & 0xFFFFFFFFu);
+        }
+
+        // Keeps the `limit` smallest ranks offered (all of them for limit 0)
+        // in a max-heap, so a worse hit is rejected with one comparison.
+        class TopRanks
+        {
+        public:
+            explicit TopRanks(std::size_t limit) : limit_(limit) {}
+
+            void Offer(std::uint64_t rank)
+            {
+                if (limit_ == 0 || heap_.size() < limit_)
+                {
+                    heap_.push_back(rank);
+                    if (limit_ != 0)
+                        std::push_heap(heap_.begin(), heap_.end());
+                }
+                else if (rank < heap_.front())
+                {
+                    std::pop_heap(heap_.begin(), heap_.end());
+                    heap_.back() = rank;
+                    std::push_heap(heap_.begin(), heap_.end());
+                }
+            }
+
+            std::vector<std::uint64_t> Take() { return std::move(heap_); }
+
+        private:
+            std::size_t limit_;
+            std::vector<std::uint64_t> heap_;
+        };
+
+        // Offers id to top if its name matches lower_text the way mode asks;
+        // text_mask is CharMask(lower_text). False if it does not match.
+        bool OfferName(const IndexStore &index, EntryId id, const std::string &lower_text, std::uint32_t text_mask,
+                       MatchMode mode, TopRanks &top)
+        {
+            std::string_view lower_name = index.LowerName(id);
+            if (mode == MatchMode::FUZZY)
+            {
+                int score;
+                if (!MaskCovers(index.NameMask(id), text_mask) || !FuzzyScore(index.Name(id), lower_name, lower_text, score))
+                    return false;
+                top.Offer(FuzzyRank(score, lower_name.size(), id));
+                return true;
+            }
+            std::size_t pos = FindLowered(lower_name, lower_text);
+            if (pos == std::string_view::npos)
+                return false;
+            top.Offer(Rank(pos, lower_name.size(), id));
+            return true;
+        }
+
+        // The column predicates of a SearchQuery, resolved against one index
+        // and ordered so the narrowest columns are read first.
+        struct ColumnFilter
+        {
+            // by extension id; empty = any
+            std::vector<bool> extensions;
+            // bit per EXTENSION_TYPE; 0 = any
+            std::uint32_t types = 0;
+            std::uint64_t min_size = 0;
+            std::uint64_t max_size = 0;
+            std::int64_t min_mtime = 0;
+            std::int64_t max_mtime = 0;
+
+            bool Narrows() const
+            {
+                return !extensions.empty() || types != 0 || min_size != 0 ||
+                       max_size != std::numeric_limits<std::uint64_t>::max() ||
+                       min_mtime != std::numeric_limits<std::int64_t>::min() ||
+                       max_mtime != std::numeric_limits<std::int64_t>::max();
+            }
+
+            // false if nothing in index can pass
+            bool Bind(const IndexStore &index, const SearchQuery &query)
+            {
+                for (EXTENSION_TYPE type : query.types)
+                    types |= 1u << static_cast<unsigned>(type);
+                min_size = query.min_size;
+                max_size = query.max_size;
+                min_mtime = query.min_mtime;
+                max_mtime = query.max_mtime;
+                if (min_size > max_size || min_mtime > max_mtime)
+                    return false;
+
+                if (query.extensions.empty())
+                    return true;
+                bool any = false;
+                extensions.assign(index.ExtensionCount(), false);
+                for (std::size_t ext = 1; ext < extensions.size(); ++ext)
+                {
+                    std::string name = ToLowerAscii(index.ExtensionName(static_cast<std::uint16_t>(ext)).substr(1));
+                    if (std::find(query.extensions.begin(), query.extensions.end(), name) != query.extensions.end())
+                        extensions[ext] = any = true;
+                }
+                return any;
+            }
+
+            bool ByMembership() const { return !extensions.empty() || types != 0; }
+
+            // the entries the extension and type filters allow, straight
+            // from the store's bitmaps
+            RoaringBitmap Members(const IndexStore &index) const
+            {
+                RoaringBitmap with_extension;
+                for (std::size_t ext = 1; ext < extensions.size(); ++ext)
+                {
+                    if (extensions[ext])
+                        with_extension |= index.ExtensionBitmap(static_cast<std::uint16_t>(ext));
+                }
+                RoaringBitmap of_type;
+                for (unsigned type = 0; type < 32; ++type)
+                {
+                    if (types >> type & 1u)
+                        of_type |= index.TypeBitmap(static_cast<EXTENSION_TYPE>(type));
+                }
+
+                if (extensions.empty())
+                    return of_type;
+                if (types != 0)
+                    with_extension &= of_type;
+                return with_extension;
+            }
+
+            bool Accepts(const IndexStore &index, EntryId id) const
+            {
+                return (types == 0 || (types >> static_cast<unsigned>(index.Type(id)) & 1u)) &&
+                       (extensions.empty() || extensions[index.ExtensionId(id)]) &&
+                       index.Size(id) >= min_size && index.Size(id) <= max_size &&
+                       index.ModifiedNs(id) >= min_mtime && index.ModifiedNs(id) <= max_mtime;
+            }
+        };
+
+        // The entry `in:` names, ROOT_ENTRY if the whole index lies below it,
+        // INVALID_ENTRY if none of it does.
+        EntryId ResolveWithin(const IndexStore &index, std::filesystem::path path)
+        {
+            if (path.is_relative())
+                path = index.RootPath() / path;
+            path = path.lexically_normal();
+            if (path.has_relative_path() && !path.has_filename())
+                path = path.parent_path(); // "a/b/" names the same directory as "a/b"
+
+            std::filesystem::path root = index.RootPath().lexically_normal();
+            if (root.has_relative_path() && !root.has_filename())
+                root = root.parent_path();
+            if (std::mismatch(path.begin(), path.end(), root.begin(), root.end()).first == path.end())
+                return ROOT_ENTRY;
+            return index.Find(path);
+        }
+
+        // runs shard 0..shard_count-1 on pool, or right here if there is one
+        template <typename Shard>
+        void RunShards(ShardPool &pool, std::size_t shard_count, std::atomic<bool> &keep_running, Shard &run_shard)
+        {
+            if (shard_count <= 1)
+            {
+                for (std::size_t shard = 0; shard < shard_count; ++shard)
+                    run_shard(shard);
+                return;
+            }
+            pool.Run(shard_count, [&run_shard](std::size_t shard) { run_shard(shard); }, keep_running);
+        }
+
+        // the best limit ranks of all shards, best first, as ids
+        std::vector<EntryId> MergeRanks(std::vector<std::vector<std::uint64_t>> &shard_ranks, std::size_t limit)
+        {
+            std::vector<std::uint64_t> ranks;
+            for (auto &part : shard_ranks)
+                ranks.insert(ranks.end(), part.begin(), part.end());
+            if (limit != 0 && ranks.size() > limit)
+            {
+                std::nth_element(ranks.begin(), ranks.begin() + limit, ranks.end());
+                ranks.resize(limit);
+            }
+            std::sort(ranks.begin(), ranks.end());
+
+            std::vector<EntryId> ids;
+            ids.reserve(ranks.size());
+            for (std::uint64_t rank : ranks)
+                ids.push_back(RankedId(rank));
+            return ids;
+        }
+    }
+
+    std::shared_ptr<const std::vector<EntryId>> NameSearch::Narrowest(const IndexStore &index, const std::string &lower_query)
+    {
+        std::lock_guard<std::mutex> lock(history_mutex_);
+
+        if (history_index_ != &index || history_generation_ != index.Generation())
+        {
+            history_.clear();
+            history_index_ = &index;
+            history_generation_ = index.Generation();
+            return nullptr;
+        }
+
+        // whatever lower_query does not contain (the tail after a backspace,
+        // or an unrelated query) can no longer be refined
+        while (!history_.empty() && lower_query.find(history_.back().lower_query) == std::string::npos)
+            history_.pop_back();
+        return history_.empty() ? nullptr : history_.back().matches;
+    }
+
+    void NameSearch::Remember(const IndexStore &index, const std::string &lower_query, std::vector<EntryId> matches)
+    {
+        std::lock_guard<std::mutex> lock(history_mutex_);
+
+        // a newer search moved on to another index version meanwhile
+        if (history_index_ != &index || history_generation_ != index.Generation())
+            return;
+        // only a refinement of the top keeps the chain of substrings intact;
+        // everything refines the empty query, which would just be all names
+        if (lower_query.empty())
+            return;
+        if (!history_.empty() && (history_.back().lower_query == lower_query ||
+                                  lower_query.find(history_.back().lower_query) == std::string::npos))
+            return;
+
+        if (history_.size() == MAX_HISTORY)
+            history_.erase(history_.begin());
+        history_.push_back({lower_query, std::make_shared<const std::vector<EntryId>>(std::move(matches))});
+    }
+
+    bool NameSearch::Superseded(std::uint64_t generation, std::atomic<bool> &keep_running) const
+    {
+        if (latest_.load(std::memory_order_relaxed) != generation)
+            keep_running = false;
+        return !keep_running;
+    }
+
+    std::vector<EntryId> NameSearch::Run(const IndexStore &index, std::string_view query, std::size_t limit, MatchMode mode)
+    {
+        const std::uint64_t generation = ++latest_;
+        const std::string lower_query = ToLowerAscii(query);
+
+        std::atomic<bool> keep_running{true};
+        auto superseded = [&]() { return Superseded(generation, keep_running); };
+
+        if (mode == MatchMode::FUZZY)
+        {
+            const std::uint32_t query_mask = CharMask(lower_query);
+            const std::size_t shard_count = (index.Capacity() + ENTRIES_PER_SHARD - 1) / ENTRIES_PER_SHARD;
+            std::vector<std::vector<std::uint64_t>> shard_ranks(shard_count);
+            auto run_shard = [&](std::size_t shard)
+            {
+                if (superseded())
+                    return;
+
+                TopRanks top(limit);
+                const EntryId first = static_cast<EntryId>(std::max<std::size_t>(shard * ENTRIES_PER_SHARD, ROOT_ENTRY + 1));
+                const EntryId end = static_cast<EntryId>(std::min<std::size_t>(index.Capacity(), (shard + 1) * ENTRIES_PER_SHARD));
+                for (EntryId id = first; id < end; ++id)
+                {
+                    // the mask column first: it turns most names down
+                    if (MaskCovers(index.NameMask(id), query_mask) && index.IsLive(id) && index.IsDirectory(id) == directories_)
+                        OfferName(index, id, lower_query, query_mask, mode, top);
+                }
+                shard_ranks[shard] = top.Take();
+            };
+            RunShards(pool_, shard_count, keep_running, run_shard);
+
+            if (superseded())
+                return {};
+            return MergeRanks(shard_ranks, limit);
+        }
+
+        // true if id matches
+        auto offer = [&](TopRanks &top, EntryId id)
+        {
+            return index.IsLive(id) && index.IsDirectory(id) == directories_ &&
+                   OfferName(index, id, lower_query, 0, MatchMode::SUBSTRING, top);
+        };
+
+        // Candidates come from the narrowest earlier query this one refines,
+        // or from the trigram postings for three characters and up, whichever
+        // is smaller. Short queries scan the name arena a block per shard
+        // unless an earlier set is already small.
+        std::shared_ptr<const std::vector<EntryId>> candidates = Narrowest(index, lower_query);
+        const bool narrow_enough = candidates && candidates->size() <= SMALL_CANDIDATE_SET;
+        if (!narrow_enough && lower_query.size() >= TrigramIndex::MIN_QUERY)
+        {
+            std::vector<EntryId> postings = index.Trigrams().Candidates(lower_query);
+            if (!candidates || postings.size() < candidates->size())
+                candidates = std::make_shared<const std::vector<EntryId>>(std::move(postings));
+        }
+        else if (!narrow_enough && candidates && candidates->size() * SCAN_OVER_CANDIDATES_RATIO > index.FileCount() + index.DirectoryCount())
+        {
+            candidates = nullptr;
+        }
+
+        const std::size_t shard_count = candidates
+                                            ? (candidates->size() + CANDIDATES_PER_SHARD - 1) / CANDIDATES_PER_SHARD
+                                            : index.NameBlockCount();
+
+        std::vector<std::vector<std::uint64_t>> shard_ranks(shard_count);
+        std::vector<std::vector<EntryId>> shard_matches(shard_count);
+        auto run_shard = [&](std::size_t shard)
+        {
+            if (superseded())
+                return;
+
+            TopRanks top(limit);
+            std::vector<EntryId> &matches = shard_matches[shard];
+            if (candidates)
+            {
+                std::size_t end = std::min(candidates->size(), (shard + 1) * CANDIDATES_PER_SHARD);
+                for (std::size_t i = shard * CANDIDATES_PER_SHARD; i < end; ++i)
+                {
+                    if (offer(top, (*candidates)[i]))
+                        matches.push_back((*candidates)[i]);
+                }
+            }
+            else
+            {
+                for (EntryId id : index.ScanNames(lower_query, shard, shard + 1))
+                {
+                    if (offer(top, id))
+                        matches.push_back(id);
+                }
+            }
+            shard_ranks[shard] = top.Take();
+        };
+
+        RunShards(pool_, shard_count, keep_running, run_shard);
+
+        if (superseded())
+            return {};
+
+        std::vector<EntryId> all_matches;
+        for (auto &part : shard_matches)
+            all_matches.insert(all_matches.end(), part.begin(), part.end());
+        Remember(index, lower_query, std::move(all_matches));
+        return MergeRanks(shard_ranks, limit);
+    }
+
+    std::vector<EntryId> NameSearch::Run(const IndexStore &index, const SearchQuery &query, std::size_t limit, MatchMode mode)
+    {
+        if (!query.HasFilters())
+            return Run(index, query.text, limit, mode);
+
+        const std::uint64_t generation = ++latest_;
+        const std::string lower_text = ToLowerAscii(query.text);
+        const std::uint32_t text_mask = CharMask(lower_text);
+
+        std::atomic<bool> keep_running{true};
+        auto superseded = [&]() { return Superseded(generation, keep_running); };
+
+        ColumnFilter filter;
+        if (!filter.Bind(index, query))
+            return {};
+
+        // Extension and type filters pick the ids from the store's bitmaps.
+        // Failing that, a size or mtime range small enough is read off the
+        // sorted orders. Failing that, in: lists its subtree, unless a column
+        // filter is there to turn most ids down first: listing follows child
+        // links all over the columns, so then the few that pass walk up their
+        // parents.
+        std::vector<EntryId> scope;
+        const EntryId within = query.within ? ResolveWithin(index, *query.within) : ROOT_ENTRY;
+        if (within == INVALID_ENTRY)
+            return {};
+
+        const OrderedIndex *range_order = nullptr;
+        std::uint64_t range_low = 0;
+        std::uint64_t range_high = 0;
+        if (!filter.ByMembership() && index.HasOrders())
+        {
+            std::size_t narrowest = index.Capacity() / SCAN_OVER_CANDIDATES_RATIO;
+            auto consider = [&](const OrderedIndex &order, std::uint64_t low, std::uint64_t high)
+            {
+                if (low == 0 && high == std::numeric_limits<std::uint64_t>::max())
+                    return;
+                std::size_t count = order.CountBetween(low, high);
+                if (count <= narrowest)
+                {
+                    narrowest = count;
+                    range_order = &order;
+                    range_low = low;
+                    range_high = high;
+                }
+            };
+            consider(index.SizeOrder(directories_), filter.min_size, filter.max_size);
+            consider(index.MtimeOrder(directories_), IndexStore::MtimeKey(filter.min_mtime), IndexStore::MtimeKey(filter.max_mtime));
+        }
+
+        const bool from_subtree = within != ROOT_ENTRY && !filter.Narrows();
+        const bool scoped = from_subtree || filter.ByMembership() || range_order;
+        const bool check_within = within != ROOT_ENTRY && !from_subtree;
+        if (from_subtree)
+        {
+            scope = index.Subtree(within);
+            std::sort(scope.begin(), scope.end());
+        }
+        else if (filter.ByMembership())
+        {
+            scope = filter.Members(index).ToVector();
+        }
+        else if (range_order)
+        {
+            range_order->VisitBetween(range_low, range_high, false, [&](const OrderedIndex::Item &item)
+            {
+                scope.push_back(item.id);
+                return true;
+            });
+            std::sort(scope.begin(), scope.end());
+        }
+
+        const std::size_t shard_count = scoped ? (scope.size() + CANDIDATES_PER_SHARD - 1) / CANDIDATES_PER_SHARD
+                                               : (index.Capacity() + ENTRIES_PER_SHARD - 1) / ENTRIES_PER_SHARD;
+        std::vector<std::vector<std::uint64_t>> shard_ranks(shard_count);
+        auto run_shard = [&](std::size_t shard)
+        {
+            if (superseded())
+                return;
+
+            TopRanks top(limit);
+            auto visit = [&](EntryId id)
+            {
+                if (!index.IsLive(id) || index.IsDirectory(id) != directories_ || !filter.Accepts(index, id))
+                    return;
+                if (check_within && (id == within || !index.IsWithin(id, within)))
+                    return;
+                if (lower_text.empty())
+                    top.Offer(Rank(0, index.Name(id).size(), id));
+                else
+                    OfferName(index, id, lower_text, text_mask, mode, top);
+            };
+            if (scoped)
+            {
+                std::size_t end = std::min(scope.size(), (shard + 1) * CANDIDATES_PER_SHARD);
+                for (std::size_t i = shard * CANDIDATES_PER_SHARD; i < end; ++i)
+                    visit(scope[i]);
+            }
+            else
+            {
+                const EntryId first = static_cast<EntryId>(std::max<std::size_t>(shard * ENTRIES_PER_SHARD, ROOT_ENTRY + 1));
+                const EntryId end = static_cast<EntryId>(std::min<std::size_t>(index.Capacity(), (shard + 1) * ENTRIES_PER_SHARD));
+                for (EntryId id = first; id < end; ++id)
+                    visit(id);
+            }
+            shard_ranks[shard] = top.Take();
+        };
+        RunShards(pool_, shard_count, keep_running, run_shard);
+
+        if (superseded())
+            return {};
+        return MergeRanks(shard_ranks, limit);
+    }
+}
@@ -0,0 +1,96 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <vector>
+#include "index_store.h"
+#include "search_query.h"
+#include "shard_pool.h"
+
+namespace fileindexer {
+
+    // how many results a search returns unless asked otherwise
+    constexpr std::size_t DEFAULT_SEARCH_LIMIT = 1000;
+
+    enum class MatchMode : std::uint8_t
+    {
+        // the query appears in the name as is, ignoring ASCII case
+        SUBSTRING,
+        // the query's characters appear in order, scored like fzf, so
+        // "flidx" finds "file_indexer.cpp"
+        FUZZY
+    };
+
+    // Substring search over the names of one kind of entry (files or
+    // directories), split across a thread pool that stays up between
+    // searches, so a keystroke starts no threads. Every shard keeps only its
+    // best `limit` hits in a bounded heap and the shards are merged at the
+    // end, so a query matching half the index costs no more memory than one
+    // matching a handful of names.
+    //
+    // Starting a search supersedes whatever the same NameSearch is still
+    // running: the older one stops at its next shard boundary and returns
+    // nothing, so typing quickly never queues up stale work.
+    //
+    // Every finished search leaves its full match set behind. A query that
+    // contains an earlier one can only match a subset of it, so typing
+    // "repo", "repor", "report" verifies fewer names at every keystroke,
+    // and backspacing lands on a set that is already there. The sets are
+    // dropped as soon as a new version of the index is searched.
+    //
+    // Fuzzy searches walk the ids instead, turn most names down by their
+    // character mask alone and score the rest. They keep no history, and
+    // share the cancellation with substring searches so switching modes
+    // mid-typing drops the stale run too.
+    class NameSearch
+    {
+    public:
+        explicit NameSearch(bool directories) : directories_(directories) {}
+
+        // Ids of matching live entries, best first, limit 0 = every match.
+        // Substring hits rank names starting with the query first; fuzzy hits
+        // rank by score. Shorter names, then lower ids, break ties.
+        std::vector<EntryId> Run(const IndexStore& index, std::string_view query, std::size_t limit,
+                                 MatchMode mode = MatchMode::SUBSTRING);
+        // Same, with the query's column filters applied first: type and
+        // extension pick ids from the store's bitmaps, a narrow size or mtime
+        // range from the store's sorted orders, in: limits them to one
+        // subtree, the remaining filters are read from their columns, and
+        // only names that pass are matched against the text. Without text
+        // every entry that passes is a hit. Without filters this is the plain
+        // search above, history and all.
+        std::vector<EntryId> Run(const IndexStore& index, const SearchQuery& query, std::size_t limit,
+                                 MatchMode mode = MatchMode::SUBSTRING);
+
+    private:
+        struct CachedQuery
+        {
+            std::string lower_query;
+            std::shared_ptr<const std::vector<EntryId>> matches;
+        };
+
+        // true once a newer Run started; also tells the pool to stop
+        bool Superseded(std::uint64_t generation, std::atomic<bool>& keep_running) const;
+        // The smallest remembered match set that lower_query can only narrow
+        // down further, or null. Forgets every query it is no refinement of.
+        std::shared_ptr<const std::vector<EntryId>> Narrowest(const IndexStore& index, const std::string& lower_query);
+        void Remember(const IndexStore& index, const std::string& lower_query, std::vector<EntryId> matches);
+
+        const bool directories_;
+        std::atomic<std::uint64_t> latest_{0};
+        // runs the shards of every search; a superseded one leaves it early
+        ShardPool pool_;
+
+        // Each entry's query is a substring of the next one's, so the top is
+        // always the narrowest set still usable.
+        std::mutex history_mutex_;
+        std::vector<CachedQuery> history_;
+        // the index version the history belongs to
+        const IndexStore* history_index_ = nullptr;
+        std::uint64_t history_generation_ = 0;
+    };
+}
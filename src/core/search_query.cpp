@@ -0,0 +1,310 @@
+#include "search_query.h"
+#include "file_indexer.h"
+#include "user_dirs.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+
+namespace fileindexer
+{
+    namespace
+    {
+        constexpr std::int64_t NS_PER_SECOND = 1000000000;
+
+        struct NamedValue
+        {
+            std::string_view name;
+            std::uint64_t value;
+        };
+
+        constexpr NamedValue SIZE_UNITS[] = {
+            {"", 1}, {"b", 1}, {"k", 1ull << 10}, {"kb", 1ull << 10}, {"m", 1ull << 20}, {"mb", 1ull << 20},
+            {"g", 1ull << 30}, {"gb", 1ull << 30}, {"t", 1ull << 40}, {"tb", 1ull << 40}};
+
+        constexpr NamedValue AGE_UNITS[] = {
+            {"s", 1}, {"min", 60}, {"h", 3600}, {"d", 86400}, {"w", 7 * 86400}, {"y", 365 * 86400}};
+
+        struct NamedType
+        {
+            std::string_view name;
+            EXTENSION_TYPE type;
+        };
+
+        constexpr NamedType TYPE_NAMES[] = {
+            {"directory", DIRECTORY}, {"dir", DIRECTORY}, {"archive", ARCHIVE}, {"file", FILE},
+            {"audio", AUDIO}, {"video", VIDEO}, {"image", IMAGE}, {"text", TEXT}, {"pdf", PDF},
+            {"doc", DOC}, {"ppt", PPT}, {"spreadsheet", SPREADSHEET}};
+
+        enum class Compare
+        {
+            LESS,
+            LESS_EQUAL,
+            EQUAL,
+            GREATER_EQUAL,
+            GREATER,
+            NONE
+        };
+
+        Compare TakeCompare(std::string_view &value)
+        {
+            auto take = [&](std::string_view op)
+            {
+                if (value.substr(0, op.size()) != op)
+                    return false;
+                value.remove_prefix(op.size());
+                return true;
+            };
+            if (take(">="))
+                return Compare::GREATER_EQUAL;
+            if (take("<="))
+                return Compare::LESS_EQUAL;
+            if (take(">"))
+                return Compare::GREATER;
+            if (take("<"))
+                return Compare::LESS;
+            if (take("="))
+                return Compare::EQUAL;
+            return Compare::NONE;
+        }
+
+        // "1.5" followed by one of units, case aside; false on anything else
+        template <std::size_t N>
+        bool ParseAmount(std::string_view text, const NamedValue (&units)[N], std::uint64_t &out)
+        {
+            std::size_t digits = 0;
+            while (digits < text.size() && ((text[digits] >= '0' && text[digits] <= '9') || text[digits] == '.'))
+                ++digits;
+            if (digits == 0)
+                return false;
+
+            const std::string number(text.substr(0, digits));
+            char *end = nullptr;
+            double amount = std::strtod(number.c_str(), &end);
+            if (end != number.c_str() + number.size())
+                return false;
+
+            const std::string unit = ToLowerAscii(text.substr(digits));
+            for (const NamedValue &u : units)
+            {
+                if (unit != u.name)
+                    continue;
+                double scaled = std::round(amount * static_cast<double>(u.value));
+                if (scaled >= static_cast<double>(std::numeric_limits<std::uint64_t>::max()))
+                    return false;
+                out = static_cast<std::uint64_t>(scaled);
+                return true;
+            }
+            return false;
+        }
+
+        bool ParseSize(std::string_view value, SearchQuery &query)
+        {
+            std::uint64_t low = 0;
+            std::uint64_t high = 0;
+            auto dots = value.find("..");
+            if (dots != std::string_view::npos)
+            {
+                if (!ParseAmount(value.substr(0, dots), SIZE_UNITS, low) || !ParseAmount(value.substr(dots + 2), SIZE_UNITS, high))
+                    return false;
+                query.min_size = std::max(query.min_size, low);
+                query.max_size = std::min(query.max_size, high);
+                return true;
+            }
+
+            Compare cmp = TakeCompare(value);
+            if (!ParseAmount(value, SIZE_UNITS, low))
+                return false;
+            switch (cmp)
+            {
+            case Compare::GREATER:
+                if (low == std::numeric_limits<std::uint64_t>::max())
+                    return false;
+                query.min_size = std::max(query.min_size, low + 1);
+                break;
+            case Compare::GREATER_EQUAL:
+                query.min_size = std::max(query.min_size, low);
+                break;
+            case Compare::LESS:
+                if (low == 0)
+                    return false;
+                query.max_size = std::min(query.max_size, low - 1);
+                break;
+            case Compare::LESS_EQUAL:
+                query.max_size = std::min(query.max_size, low);
+                break;
+            case Compare::EQUAL:
+            case Compare::NONE:
+                query.min_size = std::max(query.min_size, low);
+                query.max_size = std::min(query.max_size, low);
+                break;
+            }
+            return true;
+        }
+
+        bool ParseAge(std::string_view value, std::int64_t now, SearchQuery &query)
+        {
+            Compare cmp = TakeCompare(value);
+            std::uint64_t seconds = 0;
+            if (!ParseAmount(value, AGE_UNITS, seconds) ||
+                seconds > static_cast<std::uint64_t>(std::numeric_limits<std::int64_t>::max() / NS_PER_SECOND))
+                return false;
+            const std::int64_t since = now - static_cast<std::int64_t>(seconds) * NS_PER_SECOND;
+
+            switch (cmp)
+            {
+            case Compare::LESS:
+            case Compare::LESS_EQUAL:
+            case Compare::NONE:
+                query.min_mtime = std::max(query.min_mtime, since);
+                return true;
+            case Compare::GREATER:
+            case Compare::GREATER_EQUAL:
+                query.max_mtime = std::min(query.max_mtime, since);
+                return true;
+            case Compare::EQUAL:
+                break;
+            }
+            return false;
+        }
+
+        bool ParseExtensions(std::string_view value, SearchQuery &query)
+        {
+            std::vector<std::string> parsed;
+            for (std::size_t pos = 0; pos <= value.size();)
+            {
+                std::size_t end = std::min(value.find(',', pos), value.size());
+                std::string_view ext = value.substr(pos, end - pos);
+                if (!ext.empty() && ext.front() == '.')
+                    ext.remove_prefix(1);
+                if (ext.empty())
+                    return false;
+                parsed.push_back(ToLowerAscii(ext));
+                pos = end + 1;
+            }
+            query.extensions.insert(query.extensions.end(), parsed.begin(), parsed.end());
+            return true;
+        }
+
+        bool ParseTypes(std::string_view value, SearchQuery &query)
+        {
+            std::vector<EXTENSION_TYPE> parsed;
+            for (std::size_t pos = 0; pos <= value.size();)
+            {
+                std::size_t end = std::min(value.find(',', pos), value.size());
+                const std::string name = ToLowerAscii(value.substr(pos, end - pos));
+                auto it = std::find_if(std::begin(TYPE_NAMES), std::end(TYPE_NAMES),
+                                       [&](const NamedType &t) { return t.name == name; });
+                if (it == std::end(TYPE_NAMES))
+                    return false;
+                parsed.push_back(it->type);
+                pos = end + 1;
+            }
+            query.types.insert(query.types.end(), parsed.begin(), parsed.end());
+            return true;
+        }
+
+        bool ParseWithin(std::string_view value, SearchQuery &query)
+        {
+            if (value.empty())
+                return false;
+            std::filesystem::path path;
+            if (value.front() == '~' && (value.size() == 1 || value[1] == '/' || value[1] == '\\'))
+            {
+                std::string home = UserDirectories::Get(UserDir::Home);
+                if (home.empty())
+                    return false;
+                path = std::filesystem::path(home);
+                if (value.size() > 2)
+                    path /= std::filesystem::path(std::string(value.substr(2)));
+            }
+            else
+                path = std::filesystem::path(std::string(value));
+            query.within = path.lexically_normal();
+            return true;
+        }
+
+        // whitespace separated, with "double quotes" around spaces
+        std::vector<std::string> Tokens(std::string_view query)
+        {
+            std::vector<std::string> tokens;
+            std::string token;
+            bool quoted = false;
+            bool any = false;
+            for (char c : query)
+            {
+                if (c == '"')
+                {
+                    quoted = !quoted;
+                    any = true;
+                }
+                else if (!quoted && (c == ' ' || c == '\t'))
+                {
+                    if (any)
+                        tokens.push_back(std::move(token));
+                    token.clear();
+                    any = false;
+                }
+                else
+                {
+                    token += c;
+                    any = true;
+                }
+            }
+            if (any)
+                tokens.push_back(std::move(token));
+            return tokens;
+        }
+    }
+
+    bool SearchQuery::HasFilters() const
+    {
+        return !extensions.empty() || !types.empty() || min_size != 0 ||
+               max_size != std::numeric_limits<std::uint64_t>::max() ||
+               min_mtime != std::numeric_limits<std::int64_t>::min() ||
+               max_mtime != std::numeric_limits<std::int64_t>::max() || within.has_value();
+    }
+
+    SearchQuery ParseSearchQuery(std::string_view text)
+    {
+        SearchQuery query;
+        const std::int64_t now = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                                     std::filesystem::file_time_type::clock::now().time_since_epoch())
+                                     .count();
+
+        bool any_filter = false;
+        std::string words;
+        for (const std::string &token : Tokens(text))
+        {
+            auto colon = token.find(':');
+            bool parsed = false;
+            if (colon != std::string::npos && colon + 1 < token.size())
+            {
+                const std::string key = ToLowerAscii(std::string_view(token).substr(0, colon));
+                const std::string_view value = std::string_view(token).substr(colon + 1);
+                if (key == "ext")
+                    parsed = ParseExtensions(value, query);
+                else if (key == "type")
+                    parsed = ParseTypes(value, query);
+                else if (key == "size")
+                    parsed = ParseSize(value, query);
+                else if (key == "modified")
+                    parsed = ParseAge(value, now, query);
+                else if (key == "in")
+                    parsed = ParseWithin(value, query);
+            }
+
+            if (parsed)
+            {
+                any_filter = true;
+                continue;
+            }
+            if (!words.empty())
+                words += ' ';
+            words += token;
+        }
+
+        query.text = any_filter ? std::move(words) : std::string(text);
+        return query;
+    }
+}
@@ -0,0 +1,53 @@
+#pragma once
+
+#include <cstdint>
+#include <filesystem>
+#include <limits>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+#include "index_store.h"
+
+namespace fileindexer {
+
+    // A search box query split into column filters and the text left to match
+    // against names, e.g.
+    //
+    //   ext:pdf,docx size:>100MB modified:<7d in:~/Documents report
+    //
+    //   ext:a,b        extension is any of them, without the dot, any case
+    //   type:video     EXTENSION_TYPE by name: directory, archive, file,
+    //                  audio, video, image, text, pdf, doc, ppt, spreadsheet
+    //   size:>100MB    one of > >= < <= = then a number with B, KB, MB, GB or
+    //                  TB (powers of 1024), or a range such as 1MB..10MB
+    //   modified:<7d   age below (<) or above (>) a span in s, min, h, d, w
+    //                  or y; no operator means below
+    //   in:path        only entries below path; ~ is the home directory and
+    //                  relative paths start at the index root
+    //
+    // Values with spaces can be quoted: in:"~/My Documents". Repeating ext:
+    // or type: allows more values; every other filter narrows the results.
+    // A token that does not parse as a filter is searched for as text, so a
+    // plain query comes through exactly as typed.
+    struct SearchQuery
+    {
+        // what is left to match names against
+        std::string text;
+
+        std::vector<std::string> extensions;
+        std::vector<EXTENSION_TYPE> types;
+        std::uint64_t min_size = 0;
+        std::uint64_t max_size = std::numeric_limits<std::uint64_t>::max();
+        // file clock nanoseconds, like EntryMetadata::mtime
+        std::int64_t min_mtime = std::numeric_limits<std::int64_t>::min();
+        std::int64_t max_mtime = std::numeric_limits<std::int64_t>::max();
+        std::optional<std::filesystem::path> within;
+
+        bool HasFilters() const;
+    };
+
+    // Relative ages are turned into times against the clock here, so the
+    // parsed query can be run again without drifting.
+    SearchQuery ParseSearchQuery(std::string_view query);
+}
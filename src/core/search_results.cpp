@@ -0,0 +1,61 @@
+#include "search_results.h"
+#include "file_indexer.h"
+#include <algorithm>
+
+namespace fileindexer
+{
+    namespace
+    {
+        // [first, end) of a page, clipped to size
+        std::pair<std::size_t, std::size_t> PageBounds(std::size_t size, std::size_t first, std::size_t count)
+        {
+            first = std::min(first, size);
+            return {first, first + std::min(count, size - first)};
+        }
+    }
+
+    IndexedFile ResultRow::ToFile() const
+    {
+        return index_->MaterializeFile(id_);
+    }
+
+    IndexedDirectory ResultRow::ToDirectory() const
+    {
+        return index_->MaterializeDirectory(id_);
+    }
+
+    SearchResults::SearchResults(IndexSnapshot index, std::vector<EntryId> ids)
+        : index_(std::move(index)), ids_(std::make_shared<const std::vector<EntryId>>(std::move(ids)))
+    {
+    }
+
+    std::vector<ResultRow> SearchResults::Page(std::size_t first, std::size_t count) const
+    {
+        std::vector<ResultRow> rows;
+        const auto [begin, end] = PageBounds(Size(), first, count);
+        rows.reserve(end - begin);
+        for (std::size_t i = begin; i < end; ++i)
+            rows.emplace_back(*index_, (*ids_)[i]);
+        return rows;
+    }
+
+    std::vector<IndexedFile> SearchResults::Files(std::size_t first, std::size_t count) const
+    {
+        std::vector<IndexedFile> files;
+        const auto [begin, end] = PageBounds(Size(), first, count);
+        files.reserve(end - begin);
+        for (std::size_t i = begin; i < end; ++i)
+            files.push_back(index_->MaterializeFile((*ids_)[i]));
+        return files;
+    }
+
+    std::vector<IndexedDirectory> SearchResults::Directories(std::size_t first, std::size_t count) const
+    {
+        std::vector<IndexedDirectory> directories;
+        const auto [begin, end] = PageBounds(Size(), first, count);
+        directories.reserve(end - begin);
+        for (std::size_t i = begin; i < end; ++i)
+            directories.push_back(index_->MaterializeDirectory((*ids_)[i]));
+        return directories;
+    }
+}
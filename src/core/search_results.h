@@ -0,0 +1,68 @@
+#pragma once
+
+#include <cstddef>
+#include <filesystem>
+#include <memory>
+#include <string_view>
+#include <vector>
+#include "index_store.h"
+
+namespace fileindexer {
+
+    // One hit of a search: an id into the index version that was searched.
+    // Two words to copy; every column is read from the index when asked
+    // for, so a row that is never shown costs nothing. Valid as long as the
+    // SearchResults it came from, or any copy of them, is alive.
+    class ResultRow
+    {
+    public:
+        ResultRow(const IndexStore& index, EntryId id) : index_(&index), id_(id) {}
+
+        EntryId Id() const { return id_; }
+        bool IsDirectory() const { return index_->IsDirectory(id_); }
+        std::string_view Name() const { return index_->Name(id_); }
+        // rebuilt from the trie, so a walk up the parents
+        std::filesystem::path Path() const { return index_->PathOf(id_); }
+        // recursive for directories
+        std::uint64_t Size() const { return index_->Size(id_); }
+        std::filesystem::file_time_type ModifiedTime() const { return index_->ModifiedTime(id_); }
+        EXTENSION_TYPE Type() const { return index_->Type(id_); }
+        std::string_view Extension() const { return index_->Extension(id_); }
+
+        IndexedFile ToFile() const;
+        IndexedDirectory ToDirectory() const;
+
+    private:
+        const IndexStore* index_;
+        EntryId id_;
+    };
+
+    // The hits of one search, best first, as ids into the index version that
+    // was searched. They hold on to that version, so rows stay readable
+    // however the index changes afterwards, and copies share the ids. A
+    // million hits cost four bytes each; the caller copies out only the
+    // rows it shows, one page at a time.
+    class SearchResults
+    {
+    public:
+        SearchResults() = default;
+        SearchResults(IndexSnapshot index, std::vector<EntryId> ids);
+
+        std::size_t Size() const { return ids_ ? ids_->size() : 0; }
+        bool Empty() const { return Size() == 0; }
+        // i < Size()
+        ResultRow operator[](std::size_t i) const { return ResultRow(*index_, (*ids_)[i]); }
+        const IndexSnapshot& Index() const { return index_; }
+
+        // rows first to first + count, cut short at the end
+        std::vector<ResultRow> Page(std::size_t first, std::size_t count) const;
+        std::size_t PageCount(std::size_t page_size) const { return page_size == 0 ? 0 : (Size() + page_size - 1) / page_size; }
+        // the same rows copied out, for callers that want plain records
+        std::vector<IndexedFile> Files(std::size_t first, std::size_t count) const;
+        std::vector<IndexedDirectory> Directories(std::size_t first, std::size_t count) const;
+
+    private:
+        IndexSnapshot index_;
+        std::shared_ptr<const std::vector<EntryId>> ids_;
+    };
+}
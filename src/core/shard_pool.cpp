@@ -0,0 +1,79 @@
+#include "shard_pool.h"
+
+ShardPool::ShardPool(unsigned thread_count)
+{
+    if (thread_count == 0)
+        thread_count = std::thread::hardware_concurrency();
+    thread_count_ = thread_count > 0 ? thread_count : 1;
+}
+
+ShardPool::~ShardPool()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stopping_ = true;
+    }
+    wake_.notify_all();
+    for (auto &t : threads_)
+        t.join();
+}
+
+void ShardPool::Work(Batch &batch)
+{
+    while (*batch.keep_running)
+    {
+        const std::size_t shard = batch.next.fetch_add(1, std::memory_order_relaxed);
+        if (shard >= batch.count)
+            return;
+        (*batch.shard)(shard);
+    }
+}
+
+void ShardPool::WorkerLoop()
+{
+    std::uint64_t joined = 0;
+    std::unique_lock<std::mutex> lock(mutex_);
+    for (;;)
+    {
+        wake_.wait(lock, [&]() { return stopping_ || (batch_ && batch_number_ != joined); });
+        if (stopping_)
+            return;
+        joined = batch_number_;
+        Batch &batch = *batch_;
+        ++busy_;
+        lock.unlock();
+        Work(batch);
+        lock.lock();
+        if (--busy_ == 0)
+            done_.notify_all();
+    }
+}
+
+void ShardPool::Run(std::size_t count, const Shard &shard, const std::atomic<bool> &keep_running)
+{
+    std::lock_guard<std::mutex> run_lock(run_mutex_);
+    Batch batch{&shard, count, &keep_running};
+    if (count > 1 && threads_.empty())
+    {
+        // the calling thread is one of them
+        threads_.reserve(thread_count_ - 1);
+        for (unsigned i = 1; i < thread_count_; ++i)
+            threads_.emplace_back([this]() { WorkerLoop(); });
+    }
+    if (count > 1 && !threads_.empty())
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            batch_ = &batch;
+            ++batch_number_;
+        }
+        wake_.notify_all();
+    }
+
+    Work(batch);
+
+    // a worker that wakes up after this finds nothing to join
+    std::unique_lock<std::mutex> lock(mutex_);
+    batch_ = nullptr;
+    done_.wait(lock, [&]() { return busy_ == 0; });
+}
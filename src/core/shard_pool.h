@@ -0,0 +1,61 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Threads that outlive one batch of work, for callers that split small jobs
+// into shards many times a second (a search per keystroke) and should not
+// start and join a thread per shard every time. The threads are started by
+// the first batch that has more than one shard and sleep between batches.
+// Shards are handed out in order from a shared counter, so a thread that
+// finishes early takes the next one.
+class ShardPool
+{
+public:
+    using Shard = std::function<void(std::size_t shard)>;
+
+    // thread_count == 0 picks one thread per hardware thread
+    explicit ShardPool(unsigned thread_count = 0);
+    ~ShardPool();
+
+    ShardPool(const ShardPool&) = delete;
+    ShardPool& operator=(const ShardPool&) = delete;
+
+    // Runs shard(0) .. shard(count - 1) on the pool and the calling thread
+    // and returns once they are done. If keep_running turns false no new
+    // shard is started. Batches from different callers run one at a time.
+    void Run(std::size_t count, const Shard& shard, const std::atomic<bool>& keep_running);
+
+private:
+    struct Batch
+    {
+        const Shard* shard;
+        std::size_t count;
+        const std::atomic<bool>* keep_running;
+        std::atomic<std::size_t> next{0};
+    };
+
+    static void Work(Batch& batch);
+    void WorkerLoop();
+
+    unsigned thread_count_;
+    // held for a whole batch
+    std::mutex run_mutex_;
+
+    std::mutex mutex_;
+    std::condition_variable wake_;
+    std::condition_variable done_;
+    // the batch workers may still join, or null; guarded by mutex_
+    Batch* batch_ = nullptr;
+    std::uint64_t batch_number_ = 0;
+    // workers inside the current batch
+    unsigned busy_ = 0;
+    bool stopping_ = false;
+    std::vector<std::thread> threads_;
+};
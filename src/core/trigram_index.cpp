@@ -0,0 +1,113 @@
+#include "trigram_index.h"
+#include <algorithm>
+#include <iterator>
+
+namespace fileindexer
+{
+    std::string ToLowerAscii(std::string_view s)
+    {
+        std::string lower(s);
+        for (char &c : lower)
+            c = LowerAscii(c);
+        return lower;
+    }
+
+    std::uint32_t TrigramIndex::Key(const char *lower)
+    {
+        return (static_cast<std::uint32_t>(static_cast<unsigned char>(lower[0])) << 16) |
+               (static_cast<std::uint32_t>(static_cast<unsigned char>(lower[1])) << 8) |
+               static_cast<std::uint32_t>(static_cast<unsigned char>(lower[2]));
+    }
+
+    const TrigramIndex::Postings *TrigramIndex::Find(std::uint32_t key) const
+    {
+        const auto &lists = shards_[ShardOf(key)];
+        if (!lists)
+            return nullptr;
+        auto it = lists->find(key);
+        return it == lists->end() ? nullptr : it->second.get();
+    }
+
+    TrigramIndex::Postings &TrigramIndex::Writable(std::uint32_t key)
+    {
+        auto &lists = shards_[ShardOf(key)];
+        if (!lists)
+            lists = std::make_shared<Lists>();
+        else if (lists.use_count() > 1)
+            lists = std::make_shared<Lists>(*lists); // the lists themselves stay shared
+
+        auto &list = (*lists)[key];
+        if (!list)
+            list = std::make_shared<Postings>();
+        else if (list.use_count() > 1)
+            list = std::make_shared<Postings>(*list); // still part of a published snapshot
+        return *list;
+    }
+
+    void TrigramIndex::Add(EntryId id, std::string_view lower_name)
+    {
+        for (std::size_t i = 0; i + MIN_QUERY <= lower_name.size(); ++i)
+        {
+            Postings &list = Writable(Key(lower_name.data() + i));
+
+            // fresh entries have the highest id so far; only renames land
+            // in the middle
+            if (list.empty() || list.back() < id)
+            {
+                list.push_back(id);
+                continue;
+            }
+            auto at = std::lower_bound(list.begin(), list.end(), id);
+            if (*at != id)
+                list.insert(at, id);
+        }
+    }
+
+    std::vector<EntryId> TrigramIndex::Candidates(std::string_view lower_query) const
+    {
+        std::vector<std::uint32_t> keys;
+        for (std::size_t i = 0; i + MIN_QUERY <= lower_query.size(); ++i)
+            keys.push_back(Key(lower_query.data() + i));
+        if (keys.empty())
+            return {};
+        std::sort(keys.begin(), keys.end());
+        keys.erase(std::unique(keys.begin(), keys.end()), keys.end());
+
+        std::vector<const Postings *> lists;
+        for (std::uint32_t key : keys)
+        {
+            const Postings *list = Find(key);
+            if (!list)
+                return {};
+            lists.push_back(list);
+        }
+
+        // smallest first keeps every intermediate result as small as it gets
+        std::sort(lists.begin(), lists.end(), [](const Postings *a, const Postings *b) { return a->size() < b->size(); });
+
+        std::vector<EntryId> result(lists[0]->begin(), lists[0]->end());
+        std::vector<EntryId> next;
+        for (std::size_t i = 1; i < lists.size() && !result.empty(); ++i)
+        {
+            next.clear();
+            std::set_intersection(result.begin(), result.end(), lists[i]->begin(), lists[i]->end(), std::back_inserter(next));
+            result.swap(next);
+        }
+        return result;
+    }
+
+    std::size_t TrigramIndex::MemoryUsage() const
+    {
+        std::size_t bytes = 0;
+        for (const auto &lists : shards_)
+        {
+            if (!lists)
+                continue;
+            bytes += lists->bucket_count() * sizeof(void *) +
+                     lists->size() * (sizeof(std::uint32_t) + sizeof(std::shared_ptr<Postings>) + sizeof(Postings));
+            for (const auto &[key, list] : *lists)
+                bytes += list->capacity() * sizeof(EntryId);
+        }
+        return bytes;
+    }
+}
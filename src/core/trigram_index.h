@@ -0,0 +1,60 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+namespace fileindexer {
+
+    using EntryId = std::uint32_t;
+
+    // ASCII-only, like the std::tolower the search always used
+    inline char LowerAscii(char c)
+    {
+        return (c >= 'A' && c <= 'Z') ? static_cast<char>(c + ('a' - 'A')) : c;
+    }
+
+    std::string ToLowerAscii(std::string_view s);
+
+    // Posting lists of entry ids per lowercase trigram of their name, sorted
+    // and without duplicates so queries are plain intersections.
+    //
+    // Ids are only ever added: an entry that is removed or renamed keeps its
+    // old postings until the store is compacted, so candidates always have to
+    // be checked against the live name.
+    //
+    // Lists are shared between copies and cloned by the first copy that
+    // changes one, and so is the table of lists, in SHARDS pieces by
+    // trigram. Copying the index for a new snapshot costs SHARDS pointers,
+    // and a change clones the piece and the lists it touches.
+    class TrigramIndex
+    {
+    public:
+        static constexpr std::size_t MIN_QUERY = 3;
+
+        void Add(EntryId id, std::string_view lower_name);
+
+        // Ids whose name had every trigram of lower_query, ascending. Needs
+        // at least MIN_QUERY characters; shorter queries have to scan.
+        std::vector<EntryId> Candidates(std::string_view lower_query) const;
+
+        std::size_t MemoryUsage() const;
+
+    private:
+        using Postings = std::vector<EntryId>;
+        using Lists = std::unordered_map<std::uint32_t, std::shared_ptr<Postings>>;
+
+        static constexpr std::size_t SHARDS = 256;
+
+        static std::uint32_t Key(const char* lower);
+        static std::size_t ShardOf(std::uint32_t key) { return (key * 0x9E3779B1u) >> 24; }
+        const Postings* Find(std::uint32_t key) const;
+        Postings& Writable(std::uint32_t key);
+
+        std::array<std::shared_ptr<Lists>, SHARDS> shards_;
+    };
+}
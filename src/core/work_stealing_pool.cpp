@@ -0,0 +1,100 @@
+#include "work_stealing_pool.h"
+#include <thread>
+#include <chrono>
+
+WorkStealingPool::WorkStealingPool(unsigned thread_count)
+{
+    if (thread_count == 0)
+        thread_count = std::thread::hardware_concurrency();
+    thread_count_ = thread_count > 0 ? thread_count : 1;
+
+    queues_.reserve(thread_count_);
+    for (unsigned i = 0; i < thread_count_; ++i)
+        queues_.push_back(std::make_unique<WorkerQueue>());
+}
+
+void WorkStealingPool::Push(unsigned worker, Task task)
+{
+    auto &queue = *queues_[worker % thread_count_];
+    pending_.fetch_add(1, std::memory_order_relaxed);
+    std::lock_guard<std::mutex> lock(queue.mutex);
+    queue.tasks.push_back(std::move(task));
+}
+
+bool WorkStealingPool::PopLocal(unsigned worker, Task &out)
+{
+    auto &queue = *queues_[worker];
+    std::lock_guard<std::mutex> lock(queue.mutex);
+    if (queue.tasks.empty())
+        return false;
+    out = std::move(queue.tasks.back());
+    queue.tasks.pop_back();
+    return true;
+}
+
+bool WorkStealingPool::Steal(unsigned thief, Task &out)
+{
+    for (unsigned i = 1; i < thread_count_; ++i)
+    {
+        auto &queue = *queues_[(thief + i) % thread_count_];
+        std::unique_lock<std::mutex> lock(queue.mutex, std::try_to_lock);
+        if (!lock.owns_lock() || queue.tasks.empty())
+            continue;
+        out = std::move(queue.tasks.front());
+        queue.tasks.pop_front();
+        return true;
+    }
+    return false;
+}
+
+void WorkStealingPool::WorkerLoop(unsigned worker, const std::atomic<bool> &keep_running)
+{
+    unsigned idle_spins = 0;
+    Task task;
+
+    while (keep_running)
+    {
+        if (PopLocal(worker, task) || Steal(worker, task))
+        {
+            idle_spins = 0;
+            task(worker);
+            task = nullptr;
+            pending_.fetch_sub(1, std::memory_order_acq_rel);
+            continue;
+        }
+
+        // nothing queued anywhere and nothing running that could queue more
+        if (pending_.load(std::memory_order_acquire) == 0)
+            return;
+
+        if (++idle_spins < 64)
+            std::this_thread::yield();
+        else
+            std::this_thread::sleep_for(std::chrono::microseconds(50));
+    }
+}
+
+void WorkStealingPool::Run(const std::atomic<bool> &keep_running)
+{
+    std::vector<std::thread> threads;
+    threads.reserve(thread_count_ - 1);
+    for (unsigned i = 1; i < thread_count_; ++i)
+        threads.emplace_back([this, i, &keep_running]() { WorkerLoop(i, keep_running); });
+
+    // the calling thread works as worker 0
+    WorkerLoop(0, keep_running);
+
+    for (auto &t : threads)
+        t.join();
+
+    // only non-empty after a cancel
+    for (auto &queue : queues_)
+        queue->tasks.clear();
+    pending_ = 0;
+}
+
+void WorkStealingPool::Run()
+{
+    static const std::atomic<bool> always{true};
+    Run(always);
+}
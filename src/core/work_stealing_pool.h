@@ -0,0 +1,46 @@
+#pragma once
+
+#include <atomic>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+// Fixed-size pool of workers, each owning a deque of tasks.
+// A worker pops from the back of its own deque (depth-first, keeps the
+// directory it just listed hot) and steals from the front of the other
+// deques when it runs dry, so one huge subtree spreads over every thread.
+class WorkStealingPool
+{
+public:
+    using Task = std::function<void(unsigned worker)>;
+
+    // thread_count == 0 picks one worker per hardware thread
+    explicit WorkStealingPool(unsigned thread_count = 0);
+
+    unsigned ThreadCount() const { return thread_count_; }
+
+    // Queue a task on a worker's deque. Safe to call from inside a running task.
+    void Push(unsigned worker, Task task);
+
+    // Blocks until every queued task, and every task those push, has run.
+    // If keep_running turns false the remaining tasks are dropped instead.
+    void Run(const std::atomic<bool>& keep_running);
+    void Run();
+
+private:
+    struct WorkerQueue
+    {
+        std::mutex mutex;
+        std::deque<Task> tasks;
+    };
+
+    bool PopLocal(unsigned worker, Task& out);
+    bool Steal(unsigned thief, Task& out);
+    void WorkerLoop(unsigned worker, const std::atomic<bool>& keep_running);
+
+    unsigned thread_count_;
+    std::vector<std::unique_ptr<WorkerQueue>> queues_;
+    std::atomic<size_t> pending_{0};
+};